@@ -0,0 +1,61 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <numeric> // For std::iota
+
+void BVH::build(const std::vector<AABB>& primitiveBounds, int maxPrimsInLeaf) {
+    nodes.clear();
+    rootNodeIdx = -1;
+    primitiveIndices.resize(primitiveBounds.size());
+    std::iota(primitiveIndices.begin(), primitiveIndices.end(), 0); // 填充 0, 1, 2, ... n-1
+    if (primitiveBounds.empty()) return;
+
+    nodes.reserve(primitiveBounds.size() * 2);
+    rootNodeIdx = buildRecursive(primitiveBounds, 0, static_cast<int>(primitiveIndices.size()), maxPrimsInLeaf);
+}
+
+int BVH::buildRecursive(const std::vector<AABB>& primitiveBounds, int start, int end, int maxPrimsInLeaf) {
+    int numPrims = end - start;
+    int currentNodeIdx = static_cast<int>(nodes.size());
+    nodes.emplace_back(); // 添加一个新节点
+
+    // 计算当前图元集合的 AABB
+    AABB currentBbox;
+    for (int i = start; i < end; ++i) {
+        currentBbox.extend(primitiveBounds[primitiveIndices[i]]);
+    }
+    nodes[currentNodeIdx].bbox = currentBbox;
+
+    if (numPrims <= maxPrimsInLeaf) {
+        // 创建叶节点
+        nodes[currentNodeIdx].firstPrimitiveIdx = start;
+        nodes[currentNodeIdx].numPrimitives = numPrims;
+        return currentNodeIdx;
+    }
+
+    // 找到最长的轴，按中点分割图元
+    glm::vec3 extent = currentBbox.maxBounds - currentBbox.minBounds;
+    int axis = 0;
+    if (extent.y > extent.x) axis = 1;
+    if (extent.z > extent[axis]) axis = 2;
+
+    float midPoint = currentBbox.minBounds[axis] + extent[axis] / 2.0f;
+    auto partition_point = std::partition(primitiveIndices.begin() + start, primitiveIndices.begin() + end,
+        [&](int primIdx) {
+            return primitiveBounds[primIdx].minBounds[axis] < midPoint;
+        });
+
+    int mid = static_cast<int>(std::distance(primitiveIndices.begin(), partition_point));
+
+    // 处理分割导致一边为空的情况：强制将图元分成两半
+    if (mid == start || mid == end) {
+        mid = start + numPrims / 2;
+    }
+
+    // 递归构建左右子树（先建子树再写回，emplace_back 可能使引用失效）
+    int left = buildRecursive(primitiveBounds, start, mid, maxPrimsInLeaf);
+    int right = buildRecursive(primitiveBounds, mid, end, maxPrimsInLeaf);
+    nodes[currentNodeIdx].leftChildIdx = left;
+    nodes[currentNodeIdx].rightChildIdx = right;
+    return currentNodeIdx;
+}
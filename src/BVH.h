@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 #include "MyMath.h"
 #include "Ray.h"
 
@@ -107,4 +109,65 @@ struct BVHNode {
     // 如果是叶节点，leftChildIdx 和 rightChildIdx 无意义
     
     bool isLeaf() const { return numPrimitives > 0; }
-};
\ No newline at end of file
+};
+
+// 一棵 BVH：节点数组 + 叶节点引用的图元顺序。光线追踪用两层：每个 Mesh 一棵
+// 局部空间三角形的底层 BVH，Scene 一棵物体实例的顶层 BVH
+struct BVH {
+    std::vector<BVHNode> nodes;
+    std::vector<int> primitiveIndices; // 叶节点的 [firstPrimitiveIdx, +numPrimitives) 指向这里
+    int rootNodeIdx = -1;
+
+    bool empty() const { return rootNodeIdx == -1; }
+
+    // primitiveBounds[i] 是图元 i 的包围盒
+    void build(const std::vector<AABB>& primitiveBounds, int maxPrimsInLeaf);
+
+    // 由近到远访问光线经过的叶节点图元。visit(primIdx) 返回 true 时立即停止（any hit）；
+    // closestT 由调用方在 visit 中更新，比它更远的节点会被跳过
+    template <typename VisitFn>
+    bool traverse(const Ray& ray, const float& closestT, VisitFn visit) const {
+        if (empty()) return false;
+
+        std::vector<int> nodeStack;
+        nodeStack.push_back(rootNodeIdx);
+        while (!nodeStack.empty()) {
+            const BVHNode& node = nodes[nodeStack.back()];
+            nodeStack.pop_back();
+
+            float tMin = 0.0f, tMax = std::numeric_limits<float>::max();
+            if (!node.bbox.intersect(ray, tMin, tMax) || tMin >= closestT || tMin > ray.t_max) {
+                continue;
+            }
+
+            if (node.isLeaf()) {
+                for (int i = 0; i < node.numPrimitives; ++i) {
+                    if (visit(primitiveIndices[node.firstPrimitiveIdx + i])) return true;
+                }
+                continue;
+            }
+
+            // 先访问更近的子节点
+            float tLeft, tRight, unused;
+            bool leftHit = nodes[node.leftChildIdx].bbox.intersect(ray, tLeft, unused);
+            bool rightHit = nodes[node.rightChildIdx].bbox.intersect(ray, tRight, unused);
+            if (leftHit && rightHit) {
+                if (tLeft < tRight) {
+                    nodeStack.push_back(node.rightChildIdx);
+                    nodeStack.push_back(node.leftChildIdx);
+                } else {
+                    nodeStack.push_back(node.leftChildIdx);
+                    nodeStack.push_back(node.rightChildIdx);
+                }
+            } else if (leftHit) {
+                nodeStack.push_back(node.leftChildIdx);
+            } else if (rightHit) {
+                nodeStack.push_back(node.rightChildIdx);
+            }
+        }
+        return false;
+    }
+
+private:
+    int buildRecursive(const std::vector<AABB>& primitiveBounds, int start, int end, int maxPrimsInLeaf);
+};
@@ -0,0 +1,99 @@
+#include "CascadedShadowMap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void CascadedShadowMap::fit(const glm::vec3& lightDirection, const glm::mat4& cameraViewProjection, float nearClip,
+    float farClip, const AABB& casterBounds, const std::array<int, MAX_CASCADES>& sizes) {
+    const int activeCount = count();
+    const float shadowFar = std::min(farClip, maxDistance);
+
+    // 视锥的四条侧棱：近平面角点到远平面角点。透视和正交下视深都沿棱线性变化，
+    // 任意深度的切片角点都可以插值得到
+    const glm::mat4 invViewProjection = glm::inverse(cameraViewProjection);
+    glm::vec3 nearCorners[4], farCorners[4];
+    for (int i = 0; i < 4; ++i) {
+        glm::vec4 ndc((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, -1.0f, 1.0f);
+        glm::vec4 n = invViewProjection * ndc;
+        ndc.z = 1.0f;
+        glm::vec4 f = invViewProjection * ndc;
+        nearCorners[i] = glm::vec3(n) / n.w;
+        farCorners[i] = glm::vec3(f) / f.w;
+    }
+
+    // 光源视图固定朝向、原点在世界原点，纹素对齐才有意义
+    const glm::vec3 forward = glm::normalize(lightDirection);
+    glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
+    if (glm::abs(glm::dot(forward, up)) > 0.9f) {
+        up = glm::vec3(1.0f, 0.0f, 0.0f);
+    }
+    const glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), forward, up);
+
+    // 深度范围覆盖所有投射者，切片外（朝光源一侧）的物体也能投下阴影
+    float minZ = std::numeric_limits<float>::max(), maxZ = std::numeric_limits<float>::lowest();
+    if (casterBounds.minBounds.x <= casterBounds.maxBounds.x) {
+        for (int corner = 0; corner < 8; ++corner) {
+            glm::vec3 p((corner & 1) ? casterBounds.maxBounds.x : casterBounds.minBounds.x,
+                        (corner & 2) ? casterBounds.maxBounds.y : casterBounds.minBounds.y,
+                        (corner & 4) ? casterBounds.maxBounds.z : casterBounds.minBounds.z);
+            float z = (lightView * glm::vec4(p, 1.0f)).z;
+            minZ = std::min(minZ, z);
+            maxZ = std::max(maxZ, z);
+        }
+    }
+
+    // 对数分割要求近平面为正（正交相机的近平面可以是 0 或负数）
+    const float splitNear = std::max(nearClip, 1e-3f);
+    float sliceNear = nearClip;
+    for (int c = 0; c < activeCount; ++c) {
+        Cascade& cascade = cascades[c];
+
+        // practical split scheme: 对数分割与均匀分割按 splitLambda 混合
+        const float fraction = static_cast<float>(c + 1) / activeCount;
+        const float logSplit = splitNear * std::pow(shadowFar / splitNear, fraction);
+        const float uniformSplit = splitNear + (shadowFar - splitNear) * fraction;
+        const float sliceFar = splitLambda * logSplit + (1.0f - splitLambda) * uniformSplit;
+
+        glm::vec3 corners[8];
+        glm::vec3 center(0.0f);
+        for (int i = 0; i < 4; ++i) {
+            const glm::vec3 edge = farCorners[i] - nearCorners[i];
+            corners[i] = nearCorners[i] + edge * ((sliceNear - nearClip) / (farClip - nearClip));
+            corners[i + 4] = nearCorners[i] + edge * ((sliceFar - nearClip) / (farClip - nearClip));
+            center += corners[i] + corners[i + 4];
+        }
+        center /= 8.0f;
+        float radius = 0.0f;
+        for (const glm::vec3& corner : corners) {
+            radius = std::max(radius, glm::length(corner - center));
+        }
+        radius = std::ceil(radius * 16.0f) / 16.0f; // 量化半径，避免浮点抖动改变纹素大小
+
+        const int size = std::max(sizes[c], 1);
+
+        // 中心在光源空间按纹素对齐，相机平移时阴影边缘不闪烁
+        const float texel = 2.0f * radius / size;
+        glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+        lightCenter.x = std::floor(lightCenter.x / texel) * texel;
+        lightCenter.y = std::floor(lightCenter.y / texel) * texel;
+
+        float zNear = -maxZ, zFar = -minZ;
+        if (minZ > maxZ) { // 没有投射者
+            zNear = -lightCenter.z - radius;
+            zFar = -lightCenter.z + radius;
+        }
+        const float margin = 0.01f * (zFar - zNear) + EPSILON;
+        zNear -= margin;
+        zFar += margin;
+
+        const glm::mat4 projection = glm::ortho(lightCenter.x - radius, lightCenter.x + radius,
+            lightCenter.y - radius, lightCenter.y + radius, zNear, zFar);
+        cascade.viewProjection = projection * lightView;
+        cascade.splitFar = sliceFar;
+        cascade.nearClip = zNear;
+        cascade.farClip = zFar;
+
+        sliceNear = sliceFar;
+    }
+}
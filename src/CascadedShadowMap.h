@@ -0,0 +1,45 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+
+#include "BVH.h"
+#include "MyMath.h"
+
+// Cascaded shadow maps for a directional light.
+//
+// The camera frustum up to maxDistance is cut into cascadeCount slices (a blend of
+// logarithmic and uniform splits) and each slice gets its own orthographic map.
+// A map covers the bounding sphere of its slice rather than the slice itself, so
+// its size does not change when the camera turns, and its origin is snapped to
+// whole texels, so shadow edges do not crawl when the camera moves. The maps
+// themselves live in the renderer's ShadowAtlas.
+class CascadedShadowMap {
+public:
+    static constexpr int MAX_CASCADES = 4;
+
+    struct Cascade {
+        float splitFar = 0.0f;          // view depth at which the next cascade takes over
+        float nearClip = 0.0f, farClip = 1.0f; // orthographic depth range along the light
+        glm::mat4 viewProjection{ 1.0f };
+    };
+
+    // Settings, read by every fit() so they can change between frames
+    int cascadeCount = 3;
+    std::array<int, MAX_CASCADES> resolution = { 1024, 512, 512, 256 }; // requested atlas region sizes
+    float maxDistance = 20.0f;          // no shadows beyond this view depth
+    float splitLambda = 0.75f;          // 0 = uniform splits, 1 = logarithmic
+
+    int count() const { return std::clamp(cascadeCount, 1, MAX_CASCADES); }
+
+    // Fits the cascades to the camera. sizes are the map sizes actually granted,
+    // texel snapping depends on them. The depth range of every map spans
+    // casterBounds so that casters outside a slice still shadow it.
+    void fit(const glm::vec3& lightDirection, const glm::mat4& cameraViewProjection, float nearClip, float farClip,
+        const AABB& casterBounds, const std::array<int, MAX_CASCADES>& sizes);
+
+    const Cascade& operator[](int i) const { return cascades[i]; }
+
+private:
+    std::array<Cascade, MAX_CASCADES> cascades;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "BVH.h"
+#include "MyMath.h"
+
+// Clip-space culling volume extracted from a (model-)view-projection matrix
+// (Gribb/Hartmann). Planes built from an MVP live in the object's local space,
+// so local bounding boxes can be tested without transforming them first.
+//
+// Only the side planes and the rasterizer's near clip plane (w = EPSILON) are
+// used: triangles beyond the far plane are not clipped by the rasterizer, so
+// culling them here would change what ends up on screen.
+struct Frustum {
+    static constexpr int PLANE_COUNT = 5;
+    glm::vec4 planes[PLANE_COUNT]; // dot(plane, (p, 1)) >= 0 inside
+
+    Frustum() = default;
+
+    explicit Frustum(const glm::mat4& m) {
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        planes[0] = row3 + row0;                           // left
+        planes[1] = row3 - row0;                           // right
+        planes[2] = row3 + row1;                           // bottom
+        planes[3] = row3 - row1;                           // top
+        planes[4] = row3 - glm::vec4(0, 0, 0, EPSILON);    // near (w >= EPSILON)
+    }
+
+    // 保守测试：只有整个包围盒都在某个平面外侧时才剔除
+    bool intersects(const AABB& box) const {
+        for (const glm::vec4& plane : planes) {
+            // 取沿平面法线方向最远的顶点 (p-vertex)
+            glm::vec3 p(plane.x >= 0.0f ? box.maxBounds.x : box.minBounds.x,
+                        plane.y >= 0.0f ? box.maxBounds.y : box.minBounds.y,
+                        plane.z >= 0.0f ? box.maxBounds.z : box.minBounds.z);
+            if (plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
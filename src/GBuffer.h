@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include "Buffer.h"
+#include "MyMath.h"
+
+// Compact G-buffer of the SSAO/SSGI path, 12 bytes per pixel.
+//
+// Position is not stored: it is reconstructed from the pixel center and the
+// view-space linear depth, and SSAO compares depths directly. Normals are
+// octahedral-encoded into two 16-bit snorm values, albedo is RGBA8 (textures are
+// 8-bit, so textured albedo survives exactly).
+struct GBuffer {
+    static constexpr float NO_GEOMETRY = std::numeric_limits<float>::max();
+
+    Buffer<float> depth;     // distance along the view axis, NO_GEOMETRY where nothing was drawn
+    Buffer<uint32_t> normal; // world space, encodeNormal
+    Buffer<uint32_t> albedo; // linear base color, encodeAlbedo
+
+    void resize(int width, int height) {
+        depth = Buffer<float>(width, height);
+        normal = Buffer<uint32_t>(width, height);
+        albedo = Buffer<uint32_t>(width, height);
+    }
+
+    // normal and albedo are only read where depth says there is geometry
+    void clear() {
+        depth.clear(NO_GEOMETRY);
+    }
+
+    static uint32_t encodeNormal(const glm::vec3& n) {
+        // 投影到八面体 |x| + |y| + |z| = 1，下半球折到外侧的四个三角形
+        const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        float ex = n.x / l1, ey = n.y / l1;
+        if (n.z < 0.0f) {
+            const float fx = (1.0f - std::abs(ey)) * (ex >= 0.0f ? 1.0f : -1.0f);
+            const float fy = (1.0f - std::abs(ex)) * (ey >= 0.0f ? 1.0f : -1.0f);
+            ex = fx;
+            ey = fy;
+        }
+        return toSnorm16(ex) | (toSnorm16(ey) << 16);
+    }
+
+    static glm::vec3 decodeNormal(uint32_t packed) {
+        const float ex = static_cast<int16_t>(packed & 0xFFFF) / 32767.0f;
+        const float ey = static_cast<int16_t>(packed >> 16) / 32767.0f;
+        glm::vec3 n(ex, ey, 1.0f - std::abs(ex) - std::abs(ey));
+        if (n.z < 0.0f) {
+            n.x = (1.0f - std::abs(ey)) * (ex >= 0.0f ? 1.0f : -1.0f);
+            n.y = (1.0f - std::abs(ex)) * (ey >= 0.0f ? 1.0f : -1.0f);
+        }
+        return glm::normalize(n);
+    }
+
+    static uint32_t encodeAlbedo(const glm::vec3& c) {
+        return 0xFF000000u | (toUnorm8(c.x) << 16) | (toUnorm8(c.y) << 8) | toUnorm8(c.z);
+    }
+
+    static glm::vec3 decodeAlbedo(uint32_t packed) {
+        return glm::vec3((packed >> 16) & 0xFF, (packed >> 8) & 0xFF, packed & 0xFF) * (1.0f / 255.0f);
+    }
+
+private:
+    static uint32_t toSnorm16(float v) {
+        return static_cast<uint32_t>(static_cast<int>(std::round(std::clamp(v, -1.0f, 1.0f) * 32767.0f))) & 0xFFFF;
+    }
+
+    static uint32_t toUnorm8(float v) {
+        return static_cast<uint32_t>(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+};
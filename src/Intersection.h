@@ -9,9 +9,9 @@ struct Intersection {
     float t;
     glm::vec3 position;
     glm::vec3 normal;
-    std::shared_ptr<Material> material;
+    MaterialId materialId;
     glm::vec2 uv;
     bool hit;
 
-    Intersection() : t(std::numeric_limits<float>::max()), hit(false) {}
+    Intersection() : t(std::numeric_limits<float>::max()), materialId(DEFAULT_MATERIAL), hit(false) {}
 };
\ No newline at end of file
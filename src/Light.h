@@ -1,8 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <random>
-static std::mt19937 generator(std::random_device{}());
-static std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+static thread_local std::mt19937 generator(std::random_device{}()); // per thread: lights are sampled from parallel tiles
+static thread_local std::uniform_real_distribution<float> distribution(-0.5f, 0.5f); // has state too, keep it per thread
 
 #include "MyMath.h"
 
@@ -20,6 +23,19 @@ public:
 	virtual glm::vec3 getDirection(const glm::vec3& point) const = 0;
 	virtual float getIntensity(const glm::vec3& point) const = 0;
 	virtual float getDistance(const glm::vec3& point) const = 0;
+	// Radius around getPosition() beyond which the light contributes nothing;
+	// lights without one are never culled
+	virtual float getRange() const { return std::numeric_limits<float>::infinity(); }
+
+	// Windowed falloff (1 - (d / range)^4)^2 applied on top of getIntensity(): 1 close
+	// to the light, exactly 0 from getRange() on, so culling by range cuts nothing visible
+	float rangeWindow(const glm::vec3& point) const {
+		const float range = getRange();
+		if (!std::isfinite(range)) return 1.0f;
+		const float ratio = getDistance(point) / range;
+		const float window = std::clamp(1.0f - ratio * ratio * ratio * ratio, 0.0f, 1.0f);
+		return window * window;
+	}
 };
 
 class DirectionalLight : public Light {
@@ -43,7 +59,7 @@ public:
 	}
 
     float getDistance(const glm::vec3& point) const override {
-		return 0.0f; // parallel light has no distance
+		return std::numeric_limits<float>::infinity(); // parallel light is infinitely far away
 	}
 };
 
@@ -66,12 +82,16 @@ public:
 	}
 
 	float getIntensity(const glm::vec3& point) const override {
-        float distance2 = static_cast<float>((point - position).length());
+        float distance2 = glm::length(point - position);
         return intensity / (std::pow(distance2, 2.f) + EPSILON); // 或使用 (a + b*d + c*d^2)
     }
 
     float getDistance(const glm::vec3& point) const override {
-        return static_cast<float>((point - position).length());
+        return glm::length(point - position);
+    }
+
+    float getRange() const override {
+        return range;
     }
 };
 
@@ -116,7 +136,7 @@ public:
 
     float getIntensity(const glm::vec3& point) const override {
 
-        float distance = static_cast<float>((position - point).length());
+        float distance = glm::length(position - point);
         if (distance > range) return 0.0f;
 
         float distanceAttenuation = 1.0f - (distance / range);
@@ -143,7 +163,11 @@ public:
     }
 
     float getDistance(const glm::vec3& point) const override {
-        return static_cast<float>((position - point).length());
+        return glm::length(position - point);
+    }
+
+    float getRange() const override {
+        return range;
     }
 
     void setDirection(const glm::vec3& newDirection) {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
@@ -18,6 +19,11 @@ public:
     float ior;             // Index of Refraction (dielectrics only)
     float transparency;    // 0 = opaque, 1 = fully transparent
 
+    // Rasterizer face culling. Front faces are counter-clockwise in NDC.
+    enum class CullMode : uint8_t { Back, Front, None };
+    CullMode cullMode = CullMode::Back;        // camera passes (forward, G-buffer)
+    CullMode shadowCullMode = CullMode::None;  // shadow map pass
+
     // Optional maps
     std::vector<uint32_t> colorMap;
     std::vector<uint32_t> roughnessMap;
@@ -63,3 +69,8 @@ public:
     
     static std::shared_ptr<Material> defualtMat() { return std::make_shared<Material>("default"); }
 };
+
+// Compact handle into Scene::materials; hot loops carry this instead of a shared_ptr
+using MaterialId = uint16_t;
+constexpr MaterialId DEFAULT_MATERIAL = 0;
+constexpr MaterialId INVALID_MATERIAL = 0xFFFF;
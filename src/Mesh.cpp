@@ -1,26 +1,180 @@
 #include "Mesh.h"
 
+#include <algorithm>
+#include <numeric>
+
+#include "MeshSimplifier.h"
 #include "MyMath.h"
 #include "ResourceManager.h"
 
 void Mesh::clear() {
     vertices.clear();
     indices.clear();
+    lodIndices.clear();
+    lodClusters.clear();
+    triangles.clear();
+    bvh = BVH();
+    bounds = AABB();
+}
+
+void Mesh::updateBounds() {
+    bounds = AABB();
+    for (const auto& vertex : vertices) {
+        bounds.extend(vertex.localPos);
+    }
+}
+
+// 每级目标减半，简化不动（接缝/边界太多）时提前停止
+void Mesh::buildLods() {
+    lodIndices.clear();
+    lodIndices.reserve(MAX_LOD_LEVELS - 1);
+    while (getLodCount() < MAX_LOD_LEVELS) {
+        const std::vector<unsigned int>& previous = getLodIndices(getLodCount() - 1);
+        const size_t triangleCount = previous.size() / 3;
+        if (triangleCount < 2 * MIN_LOD_TRIANGLES) break;
+
+        std::vector<unsigned int> simplified = MeshSimplifier::simplify(vertices, previous, triangleCount / 2 * 3);
+        if (simplified.size() > previous.size() * 3 / 4) break;
+        lodIndices.push_back(std::move(simplified));
+    }
+}
+
+// 把一级 LOD 的三角形按邻接关系分簇，并按簇重新排列 indices。
+// 邻接按位置焊接计算，UV/法线接缝不会把簇切开
+static void buildLevelClusters(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices,
+    std::vector<MeshCluster>& clusters) {
+    clusters.clear();
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) return;
+
+    // 位置焊接：排序后相同位置的顶点共用一个 id
+    std::vector<uint32_t> order(vertices.size());
+    std::iota(order.begin(), order.end(), 0u);
+    auto positionLess = [&](uint32_t a, uint32_t b) {
+        const glm::vec3& p = vertices[a].localPos;
+        const glm::vec3& q = vertices[b].localPos;
+        return p.x != q.x ? p.x < q.x : (p.y != q.y ? p.y < q.y : p.z < q.z);
+    };
+    std::sort(order.begin(), order.end(), positionLess);
+    std::vector<uint32_t> posId(vertices.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        posId[order[i]] = (i > 0 && !positionLess(order[i - 1], order[i])) ? posId[order[i - 1]] : order[i];
+    }
+
+    // 位置 -> 三角形 邻接表
+    std::vector<uint32_t> adjOffsets(vertices.size() + 1, 0), adjTriangles(triangleCount * 3);
+    for (unsigned int idx : indices) ++adjOffsets[posId[idx] + 1];
+    for (size_t v = 0; v < vertices.size(); ++v) adjOffsets[v + 1] += adjOffsets[v];
+    {
+        std::vector<uint32_t> cursor(adjOffsets.begin(), adjOffsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; ++i) adjTriangles[cursor[posId[indices[i]]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    // 从第一个未分配的三角形开始广度优先生长，簇大致呈圆片状
+    std::vector<char> assigned(triangleCount, 0);
+    std::vector<uint32_t> queue;
+    std::vector<unsigned int> ordered;
+    ordered.reserve(indices.size());
+    size_t seed = 0;
+    while (ordered.size() < indices.size()) {
+        while (assigned[seed]) ++seed;
+        queue.assign(1, static_cast<uint32_t>(seed));
+        assigned[seed] = 1;
+        for (size_t head = 0; head < queue.size(); ++head) {
+            const size_t t = queue[head];
+            for (int j = 0; j < 3; ++j) {
+                const uint32_t p = posId[indices[t * 3 + j]];
+                for (uint32_t k = adjOffsets[p]; k < adjOffsets[p + 1] && queue.size() < Mesh::MAX_CLUSTER_TRIANGLES; ++k) {
+                    const uint32_t u = adjTriangles[k];
+                    if (assigned[u]) continue;
+                    assigned[u] = 1;
+                    queue.push_back(u);
+                }
+            }
+        }
+
+        MeshCluster cluster;
+        cluster.firstIndex = static_cast<uint32_t>(ordered.size());
+        cluster.indexCount = static_cast<uint32_t>(queue.size() * 3);
+        glm::vec3 normalSum(0.0f);
+        for (uint32_t t : queue) {
+            const glm::vec3& a = vertices[indices[t * 3]].localPos;
+            const glm::vec3& b = vertices[indices[t * 3 + 1]].localPos;
+            const glm::vec3& c = vertices[indices[t * 3 + 2]].localPos;
+            cluster.bounds.extend(a);
+            cluster.bounds.extend(b);
+            cluster.bounds.extend(c);
+            glm::vec3 n = glm::cross(b - a, c - a);
+            float len = glm::length(n);
+            if (len > 0.0f) normalSum += n / len;
+            ordered.insert(ordered.end(), { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] });
+        }
+        cluster.center = (cluster.bounds.minBounds + cluster.bounds.maxBounds) * 0.5f;
+        cluster.radius = 0.5f * glm::length(cluster.bounds.maxBounds - cluster.bounds.minBounds);
+
+        // 法线锥：轴取平均面法线，半角取与轴夹角最大的面；超过半球时无法剔除
+        float axisLength = glm::length(normalSum);
+        if (axisLength > 1e-3f) {
+            cluster.coneAxis = normalSum / axisLength;
+            float minCos = 1.0f;
+            for (uint32_t t : queue) {
+                const glm::vec3& a = vertices[indices[t * 3]].localPos;
+                glm::vec3 n = glm::cross(vertices[indices[t * 3 + 1]].localPos - a, vertices[indices[t * 3 + 2]].localPos - a);
+                float len = glm::length(n);
+                if (len > 0.0f) minCos = std::min(minCos, glm::dot(cluster.coneAxis, n / len));
+            }
+            cluster.coneCutoff = minCos > 0.0f ? std::sqrt(1.0f - minCos * minCos) : 1.0f;
+        }
+        clusters.push_back(cluster);
+    }
+    indices.swap(ordered);
 }
 
-// 逐三角形求交
-bool Mesh::intersect(const Ray& ray, Intersection& isect, const std::shared_ptr<Material>& material) const {
+void Mesh::buildClusters() {
+    lodClusters.resize(getLodCount());
+    buildLevelClusters(vertices, indices, lodClusters[0]);
+    for (size_t level = 0; level < lodIndices.size(); ++level) {
+        buildLevelClusters(vertices, lodIndices[level], lodClusters[level + 1]);
+    }
+}
+
+void Mesh::buildBVH() {
+    triangles.clear();
+    triangles.reserve(indices.size() / 3);
+    std::vector<AABB> primitiveBounds;
+    primitiveBounds.reserve(indices.size() / 3);
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        TransformedVertex corners[3];
+        AABB box;
+        for (int j = 0; j < 3; ++j) {
+            const Vertex& v = vertices[indices[i + j]];
+            corners[j] = TransformedVertex(v.localPos, v.normal, v.uv);
+            box.extend(v.localPos);
+        }
+        triangles.push_back(Triangle(corners[0], corners[1], corners[2], DEFAULT_MATERIAL));
+        primitiveBounds.push_back(box);
+    }
+    bvh.build(primitiveBounds, MAX_PRIMS_IN_LEAF);
+}
+
+bool Mesh::intersect(const Ray& localRay, Intersection& isect) const {
     bool hit = false;
-    for (const auto& triangle : triangles) {
-        if (triangle.intersect(ray, isect)) { // triangle's material is set in object constructor
+    bvh.traverse(localRay, isect.t, [&](int primIdx) {
+        Intersection tempIsect;
+        if (triangles[primIdx].intersect(localRay, tempIsect) && tempIsect.t < isect.t) {
+            isect = tempIsect;
             hit = true;
         }
-    }
+        return false;
+    });
     return hit;
 }
 
-bool Mesh::intersect(const Ray& ray, Intersection& isect) const {
-    return false; // placeholder for now, as Scene BVH will handle it
+bool Mesh::occluded(const Ray& localRay) const {
+    return bvh.traverse(localRay, localRay.t_max, [&](int primIdx) {
+        Intersection tempIsect;
+        return triangles[primIdx].intersect(localRay, tempIsect);
+    });
 }
 
 Mesh::Mesh() : name("default") {}
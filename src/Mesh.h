@@ -1,9 +1,26 @@
 #pragma once
+#include <algorithm>
+#include <cstdint>
 #include <string>
 #include <vector>
+#include "BVH.h"
 #include "Vertex.h"
 #include "Triangle.h"
 
+// A run of up to MAX_CLUSTER_TRIANGLES spatially connected triangles in one LOD
+// index list, culled as a unit before vertex shading
+struct MeshCluster {
+    uint32_t firstIndex = 0;   // into the level's index list
+    uint32_t indexCount = 0;
+    AABB bounds;               // local space
+    glm::vec3 center{ 0.0f };  // bounding sphere, local space
+    float radius = 0.0f;
+    // Normal cone: every face normal lies within the cone's half angle of
+    // coneAxis. coneCutoff = sin(half angle); >= 1 when the cone can never cull.
+    glm::vec3 coneAxis{ 0.0f, 0.0f, 1.0f };
+    float coneCutoff = 1.0f;
+};
+
 class Mesh {
 private:
     std::string name;
@@ -11,10 +28,25 @@ public:
     
 	std::vector<Vertex> vertices;
 	std::vector<unsigned int> indices;
+    // Local-space triangles of level 0 and their bottom-level BVH, built once per
+    // asset; ray tracing instances transform the ray instead of the mesh
     std::vector<Triangle> triangles;
+    BVH bvh;
+    static constexpr int MAX_PRIMS_IN_LEAF = 4;
+
+    // Simplified index lists built at import time. Level 0 is `indices`; each
+    // further level has roughly half the triangles of the previous one and
+    // indexes the same vertex array.
+    static constexpr int MAX_LOD_LEVELS = 4;
+    static constexpr size_t MIN_LOD_TRIANGLES = 64;
+    std::vector<std::vector<unsigned int>> lodIndices; // levels 1..n
 
-    size_t firstTriangleIdx = -1;
-    size_t numTriangles = 0;
+    // Clusters per LOD level (level 0 first). Each level's index list is ordered
+    // cluster by cluster, so a cluster is a contiguous index range.
+    static constexpr size_t MAX_CLUSTER_TRIANGLES = 128;
+    std::vector<std::vector<MeshCluster>> lodClusters;
+
+    AABB bounds; // local-space bounds of vertices, used for raster culling
 
     Mesh();
     Mesh(const std::string& path);
@@ -22,11 +54,24 @@ public:
     std::string getName() const { return name; }
     void setName(const std::string& newName) { name = newName; }
 	void clear();
+    void updateBounds();
+    void buildLods();
+    void buildClusters();
+    void buildBVH();
+
+    int getLodCount() const { return 1 + static_cast<int>(lodIndices.size()); }
+    const std::vector<unsigned int>& getLodIndices(int level) const {
+        return level <= 0 ? indices : lodIndices[std::min<size_t>(level, lodIndices.size()) - 1];
+    }
+    const std::vector<MeshCluster>& getLodClusters(int level) const {
+        static const std::vector<MeshCluster> none;
+        if (lodClusters.empty()) return none;
+        return lodClusters[std::clamp(level, 0, static_cast<int>(lodClusters.size()) - 1)];
+    }
 
     void output() const;
 
-    // 逐三角形求交
-    bool intersect(const Ray& ray, Intersection& isect, const std::shared_ptr<Material>& material) const;
-    // BVH求交
-    bool intersect(const Ray& ray, Intersection& isect) const;
+    // BVH求交，光线在局部空间；命中的 t 与光线参数一致
+    bool intersect(const Ray& localRay, Intersection& isect) const;
+    bool occluded(const Ray& localRay) const;
 };
\ No newline at end of file
@@ -0,0 +1,236 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+#include "MyMath.h"
+
+namespace {
+
+// Symmetric 4x4 error quadric, upper triangle: xx xy xz xw yy yz yw zz zw ww
+struct Quadric {
+    double a[10] = {};
+
+    void addPlane(const glm::vec3& n, float d, float weight) {
+        const double p[4] = { n.x, n.y, n.z, d };
+        int k = 0;
+        for (int i = 0; i < 4; ++i) {
+            for (int j = i; j < 4; ++j) {
+                a[k++] += weight * p[i] * p[j];
+            }
+        }
+    }
+
+    Quadric& operator+=(const Quadric& o) {
+        for (int k = 0; k < 10; ++k) a[k] += o.a[k];
+        return *this;
+    }
+
+    // v^T Q v with v = (p, 1)
+    double error(const glm::vec3& p) const {
+        const double x = p.x, y = p.y, z = p.z;
+        return a[0] * x * x + 2.0 * a[1] * x * y + 2.0 * a[2] * x * z + 2.0 * a[3] * x
+             + a[4] * y * y + 2.0 * a[5] * y * z + 2.0 * a[6] * y
+             + a[7] * z * z + 2.0 * a[8] * z
+             + a[9];
+    }
+};
+
+struct Collapse {
+    unsigned int from, to;
+    double cost;
+};
+
+uint64_t edgeKey(unsigned int a, unsigned int b) {
+    return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+}
+
+struct PositionHash {
+    size_t operator()(const glm::vec3& p) const {
+        uint32_t bits[3];
+        std::memcpy(bits, &p, sizeof(bits));
+        return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+    }
+};
+
+// 翻转检测：移动后法线偏转超过约 78 度视为翻转
+constexpr float MIN_NORMAL_COS = 0.2f;
+// 同一位置上法线夹角超过 60 度视为硬边（如立方体棱），不参与简化
+constexpr float CREASE_NORMAL_COS = 0.5f;
+constexpr float UV_SEAM_EPSILON = 1e-4f;
+
+} // namespace
+
+std::vector<unsigned int> MeshSimplifier::simplify(const std::vector<Vertex>& vertices,
+    const std::vector<unsigned int>& indices, size_t targetIndexCount) {
+    const size_t vertexCount = vertices.size();
+    std::vector<unsigned int> result = indices;
+    if (result.size() <= targetIndexCount || vertexCount == 0) return result;
+
+    // 1. 按位置焊接：OBJ 按 v/vt/vn 去重，同一位置会有多个顶点（wedge），
+    //    位置决定拓扑，wedge 只携带属性
+    std::vector<unsigned int> posId(vertexCount);
+    std::vector<char> locked(vertexCount, 0);
+    {
+        std::unordered_map<glm::vec3, unsigned int, PositionHash> welded;
+        welded.reserve(vertexCount);
+        for (size_t v = 0; v < vertexCount; ++v) {
+            auto it = welded.emplace(vertices[v].localPos, static_cast<unsigned int>(v)).first;
+            const unsigned int p = posId[v] = it->second;
+            // UV 不连续或硬边处的位置固定不动，否则会撕开纹理/棱角；
+            // 平滑着色和低多边形的逐面法线仍然可以简化
+            const Vertex& first = vertices[p];
+            if (glm::length(vertices[v].uv - first.uv) > UV_SEAM_EPSILON
+                || glm::dot(vertices[v].normal, first.normal) < CREASE_NORMAL_COS * glm::length(vertices[v].normal) * glm::length(first.normal)) {
+                locked[p] = 1;
+            }
+        }
+    }
+
+    // 2. 每个位置累加相邻三角形平面的二次误差（按面积加权）
+    std::vector<Quadric> quadrics(vertexCount);
+    std::unordered_map<uint64_t, int> edgeUse;
+    for (size_t i = 0; i + 2 < result.size(); i += 3) {
+        const unsigned int p[3] = { posId[result[i]], posId[result[i + 1]], posId[result[i + 2]] };
+        const glm::vec3& a = vertices[p[0]].localPos;
+        glm::vec3 n = glm::cross(vertices[p[1]].localPos - a, vertices[p[2]].localPos - a);
+        float len = glm::length(n);
+        if (len > 0.0f) {
+            n /= len;
+            for (unsigned int k : p) quadrics[k].addPlane(n, -glm::dot(n, a), 0.5f * len);
+        }
+        for (int e = 0; e < 3; ++e) ++edgeUse[edgeKey(p[e], p[(e + 1) % 3])];
+    }
+
+    // 3. 开放边界和非流形边上的顶点同样固定，避免产生裂缝
+    for (const auto& [key, uses] : edgeUse) {
+        if (uses != 2) {
+            locked[key >> 32] = 1;
+            locked[key & 0xFFFFFFFFu] = 1;
+        }
+    }
+
+    std::vector<unsigned int> remap(vertexCount);
+    std::vector<uint32_t> adjOffsets, adjTriangles;
+    std::vector<Collapse> candidates;
+    std::vector<char> touched;
+    std::vector<std::pair<unsigned int, unsigned int>> wedgeMoves; // (a 的 wedge, b 的 wedge)
+
+    // 4. 多轮贪心坍缩：每轮内相互独立的边按代价从小到大处理
+    while (result.size() > targetIndexCount) {
+        const size_t triangleCount = result.size() / 3;
+
+        // 顶点(焊接后) -> 三角形 邻接表
+        adjOffsets.assign(vertexCount + 1, 0);
+        for (unsigned int idx : result) ++adjOffsets[posId[idx] + 1];
+        for (size_t v = 0; v < vertexCount; ++v) adjOffsets[v + 1] += adjOffsets[v];
+        adjTriangles.resize(result.size());
+        {
+            std::vector<uint32_t> cursor(adjOffsets.begin(), adjOffsets.end() - 1);
+            for (size_t i = 0; i < result.size(); ++i) adjTriangles[cursor[posId[result[i]]]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        // from/to 取自同一三角形，to 即 from 所在面上 b 的 wedge
+        candidates.clear();
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (int e = 0; e < 3; ++e) {
+                unsigned int a = result[i + e], b = result[i + (e + 1) % 3];
+                for (int dir = 0; dir < 2; ++dir, std::swap(a, b)) {
+                    unsigned int pa = posId[a], pb = posId[b];
+                    if (locked[pa]) continue;
+                    Quadric q = quadrics[pa];
+                    q += quadrics[pb];
+                    candidates.push_back({ a, b, q.error(vertices[b].localPos) });
+                }
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(),
+            [](const Collapse& l, const Collapse& r) { return l.cost < r.cost; });
+
+        for (size_t v = 0; v < vertexCount; ++v) remap[v] = static_cast<unsigned int>(v);
+        touched.assign(vertexCount, 0);
+        const size_t trianglesToRemove = (result.size() - targetIndexCount + 2) / 3;
+        size_t removed = 0;
+
+        for (const Collapse& c : candidates) {
+            if (removed >= trianglesToRemove) break;
+            const unsigned int pa = posId[c.from], pb = posId[c.to];
+            if (pa == pb || touched[pa] || touched[pb]) continue;
+
+            const glm::vec3& target = vertices[c.to].localPos;
+            bool valid = true;
+            size_t collapsed = 0;
+            for (uint32_t k = adjOffsets[pa]; k < adjOffsets[pa + 1] && valid; ++k) {
+                const unsigned int* tri = &result[adjTriangles[k] * 3];
+                glm::vec3 p[3], moved[3];
+                bool hasTarget = false;
+                for (int j = 0; j < 3; ++j) {
+                    p[j] = moved[j] = vertices[tri[j]].localPos;
+                    if (posId[tri[j]] == pa) moved[j] = target;
+                    if (posId[tri[j]] == pb) hasTarget = true;
+                }
+                if (hasTarget) { ++collapsed; continue; } // 坍缩后退化，直接删除
+
+                glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+                float lenBefore = glm::length(before), lenAfter = glm::length(after);
+                if (lenAfter <= 0.0f || glm::dot(before, after) < MIN_NORMAL_COS * lenBefore * lenAfter) {
+                    valid = false;
+                }
+            }
+            if (!valid) continue;
+
+            // a 的每个 wedge 都要找到 b 的对应 wedge：优先取共享该 wedge 的
+            // 待删三角形里的 b，否则取法线最接近的（a 不在 UV 接缝上，周围的
+            // b wedge UV 都相同）
+            wedgeMoves.clear();
+            for (uint32_t k = adjOffsets[pa]; k < adjOffsets[pa + 1]; ++k) {
+                const unsigned int* tri = &result[adjTriangles[k] * 3];
+                for (int j = 0; j < 3; ++j) {
+                    if (posId[tri[j]] != pa) continue;
+                    const unsigned int w = tri[j];
+                    bool known = false;
+                    for (const auto& move : wedgeMoves) known |= move.first == w;
+                    if (!known) wedgeMoves.push_back({ w, c.to });
+                }
+            }
+            for (auto& move : wedgeMoves) {
+                float bestCos = -2.0f;
+                bool shared = false;
+                for (uint32_t k = adjOffsets[pa]; k < adjOffsets[pa + 1] && !shared; ++k) {
+                    const unsigned int* tri = &result[adjTriangles[k] * 3];
+                    const bool hasWedge = tri[0] == move.first || tri[1] == move.first || tri[2] == move.first;
+                    for (int j = 0; j < 3; ++j) {
+                        if (posId[tri[j]] != pb) continue;
+                        if (hasWedge) { move.second = tri[j]; shared = true; break; }
+                        float cosine = glm::dot(vertices[tri[j]].normal, vertices[move.first].normal);
+                        if (cosine > bestCos) { bestCos = cosine; move.second = tri[j]; }
+                    }
+                }
+            }
+
+            for (const auto& move : wedgeMoves) remap[move.first] = move.second;
+            quadrics[pb] += quadrics[pa];
+            // 周围的顶点本轮不再移动，保证上面的翻转检测仍然成立
+            for (uint32_t k = adjOffsets[pa]; k < adjOffsets[pa + 1]; ++k) {
+                const unsigned int* tri = &result[adjTriangles[k] * 3];
+                for (int j = 0; j < 3; ++j) touched[posId[tri[j]]] = 1;
+            }
+            removed += collapsed;
+        }
+        if (removed == 0) break; // 剩下的边都被固定或会翻转
+
+        size_t out = 0;
+        for (size_t t = 0; t < triangleCount; ++t) {
+            const unsigned int i0 = remap[result[t * 3]], i1 = remap[result[t * 3 + 1]], i2 = remap[result[t * 3 + 2]];
+            if (posId[i0] == posId[i1] || posId[i1] == posId[i2] || posId[i0] == posId[i2]) continue;
+            result[out++] = i0;
+            result[out++] = i1;
+            result[out++] = i2;
+        }
+        result.resize(out);
+    }
+    return result;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include "Vertex.h"
+
+// Quadric error metric (Garland-Heckbert) edge-collapse simplification.
+// Vertices are never created or moved: every collapse snaps one vertex onto a
+// neighbour, so all LOD levels index the original vertex array and share the
+// same post-transform vertex cache.
+class MeshSimplifier {
+private:
+    MeshSimplifier() = default; // Prevent instantiation
+
+public:
+    // Returns a new index list with at most targetIndexCount indices, or as close
+    // as possible without moving UV/normal seams or open borders.
+    static std::vector<unsigned int> simplify(const std::vector<Vertex>& vertices,
+        const std::vector<unsigned int>& indices, size_t targetIndexCount);
+};
@@ -14,6 +14,8 @@ void Object::update() {
                                glm::rotate(glm::mat4(1.0f), rotation.x, glm::vec3(1, 0, 0));
     glm::mat4 scaleMatrix = glm::scale(glm::mat4(1.0f), scale);
     matrix = translationMatrix * rotationMatrix * scaleMatrix;
+    inverseMatrix = glm::inverse(matrix);
+    normalMatrix = glm::transpose(glm::mat3(inverseMatrix));
 }
 
 
@@ -48,16 +50,33 @@ void Object::setScale(const glm::vec3& newScale) {
 }
 
 void Object::setMesh(const std::string& meshPath) {
-	Mesh new_mesh;
-	bool success = ResourceManager::loadMeshFromFile(meshPath, new_mesh);
-	if (!success) {
+	std::shared_ptr<const Mesh> sharedMesh = ResourceManager::loadSharedMesh(meshPath);
+	if (!sharedMesh) {
         SDL_Log("Failed to load mesh from file: %s", meshPath.c_str());
 		return;
 	}
-	mesh = new_mesh;
+	mesh = std::move(sharedMesh);
 	update();
 }
 
+const Mesh& Object::getMesh() const {
+	static const Mesh emptyMesh;
+	return mesh ? *mesh : emptyMesh;
+}
+
+// 局部包围盒的 8 个角变换到世界空间
+AABB Object::getWorldBounds() const {
+	const AABB& local = getMesh().bounds;
+	AABB world;
+	for (int corner = 0; corner < 8; ++corner) {
+		glm::vec3 p((corner & 1) ? local.maxBounds.x : local.minBounds.x,
+		            (corner & 2) ? local.maxBounds.y : local.minBounds.y,
+		            (corner & 4) ? local.maxBounds.z : local.minBounds.z);
+		world.extend(glm::vec3(matrix * glm::vec4(p, 1.0f)));
+	}
+	return world;
+}
+
 void Object::setAsPrimitive(Object::PrimitiveType PrimitiveType) {
 	isPrimitive = true;
 	primitive = PrimitiveType;
@@ -86,23 +105,37 @@ void Object::setAsPrimitive(Object::PrimitiveType PrimitiveType) {
 
 void Object::updateMesh() {
     update(); // 更新transform矩阵
-    mesh.triangles.clear();
-    glm::mat4 modelMatrix = getMatrix(); // 获取transform矩阵
-    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelMatrix)));
-    for (size_t i = 0; i < mesh.indices.size(); i += 3) {
-        TransformedVertex transformedVertics[3];
-        for (int j = 0; j < 3; ++j) {
-            glm::vec3 worldPos = modelMatrix * glm::vec4(mesh.vertices[mesh.indices[i + j]].localPos, 1.0f);
-            glm::vec3 worldNormal = glm::normalize(normalMatrix * mesh.vertices[mesh.indices[i + j]].normal);
-            transformedVertics[j] = TransformedVertex(worldPos, worldNormal, mesh.vertices[mesh.indices[i + j]].uv);
-        }
-        mesh.triangles.push_back(Triangle(transformedVertics[0], transformedVertics[1], transformedVertics[2], material));
-    }
 }
 
-// 逐三角形求交
+// 方向不归一化，局部空间的 t 与世界空间的 t 相同
+static Ray toLocalRay(const Ray& ray, const glm::mat4& inverseMatrix) {
+    Ray localRay = ray;
+    localRay.origin = glm::vec3(inverseMatrix * glm::vec4(ray.origin, 1.0f));
+    localRay.direction = glm::mat3(inverseMatrix) * ray.direction;
+    return localRay;
+}
+
+bool Object::intersectMesh(const Ray& ray, Intersection& isect) const {
+    if (!mesh) return false;
+    Intersection localIsect;
+    localIsect.t = isect.t;
+    if (!mesh->intersect(toLocalRay(ray, inverseMatrix), localIsect)) return false;
+
+    isect.t = localIsect.t;
+    isect.position = ray.origin + localIsect.t * ray.direction;
+    isect.normal = glm::normalize(normalMatrix * localIsect.normal);
+    isect.uv = localIsect.uv;
+    isect.materialId = materialId;
+    isect.hit = true;
+    return true;
+}
+
+bool Object::occludesMesh(const Ray& ray) const {
+    return mesh && mesh->occluded(toLocalRay(ray, inverseMatrix));
+}
+
 bool GenericObject::intersect(const Ray& ray, Intersection& isect) const {
-    return mesh.intersect(ray, isect, material);
+    return intersectMesh(ray, isect);
 }
 
 void Sphere::updateRadius() {
@@ -147,7 +180,7 @@ bool Sphere::intersect(const Ray& ray, Intersection& isect) const {
     isect.t = t;
     isect.position = ray.origin + t * ray.direction;
     isect.normal = glm::normalize(isect.position - getPosition());
-    isect.material = getMaterial();
+    isect.materialId = materialId;
     isect.hit = true;
     return true;
 }
@@ -213,7 +246,7 @@ bool Plane::intersect(const Ray& ray, Intersection& isect) const {
 
     isect.t = t;
     isect.normal = normal;
-    isect.material = getMaterial();
+    isect.materialId = materialId;
     isect.hit = true;
 
     return true;
@@ -279,7 +312,7 @@ bool Cube::intersect(const Ray& ray, Intersection& isect) const {
 
 	isect.normal = normal; // 归一化法线
 	// isect.normal = glm::vec3(0, 1, 0);
-    isect.material = getMaterial();
+    isect.materialId = materialId;
     isect.hit = true;
 
     return true;
@@ -317,7 +350,7 @@ bool Cylinder::intersect(const Ray& ray, Intersection& isect) const {
     isect.t = t;
     isect.position = hitPoint;
     isect.normal = glm::normalize(glm::vec3(hitPoint.x - position.x, 0.0f, hitPoint.z - position.z));
-    isect.material = getMaterial();
+    isect.materialId = materialId;
     isect.hit = true;
 
     return true;
@@ -349,7 +382,7 @@ bool Cone::intersect(const Ray& ray, Intersection& isect) const {
     isect.t = t;
     isect.position = hitPoint;
     isect.normal = glm::normalize(glm::vec3(hitPoint.x - position.x, -k * height, hitPoint.z - position.z));
-    isect.material = getMaterial();
+    isect.materialId = materialId;
     isect.hit = true;
 
     return true;
@@ -383,9 +416,8 @@ bool Torus::intersect(const Ray& ray, Intersection& isect) const {
     glm::vec3 hitPoint = isect.position - position;
     float distToCenter = glm::length(glm::vec3(hitPoint.x, 0.0f, hitPoint.z));
     isect.normal = glm::normalize(hitPoint - glm::vec3(position.x, position.y, position.z + distToCenter));
-    isect.material = getMaterial();
+    isect.materialId = materialId;
     isect.hit = true;
 
     return true;
-    // return mesh.intersect(ray, isect, material);
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <string>
 
 #include "Material.h"
@@ -21,15 +22,18 @@ public:
 		TORUS
 	};
 protected:
-	Mesh mesh;
+	std::shared_ptr<const Mesh> mesh; // shared, immutable asset; the object only adds a transform and a material
 	bool isPrimitive = false;
 	Object::PrimitiveType primitive;
 	std::shared_ptr<Material> material;
+	MaterialId materialId = DEFAULT_MATERIAL; // index of material in the owning Scene's table
 
 	glm::vec3 position;
 	glm::vec3 rotation;
 	glm::vec3 scale;
 	glm::mat4 matrix;
+	glm::mat4 inverseMatrix;  // world -> local, for instanced ray tracing
+	glm::mat3 normalMatrix;
 
 	glm::vec3 delta_position;
 	glm::vec3 delta_rotation;
@@ -37,12 +41,15 @@ protected:
 
 public:
 	Object() : position(0, 0, 0), rotation(0, 0, 0), scale(1, 1, 1) {
-		matrix = glm::mat4();
+		update();
 	}
-	Object(const Mesh& mesh, const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale)
-		: mesh(mesh), position(position), rotation(rotation), scale(scale) {
+	Object(std::shared_ptr<const Mesh> mesh, const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale)
+		: mesh(std::move(mesh)), position(position), rotation(rotation), scale(scale) {
 		update();
 	}
+	// Takes a private copy of the mesh; prefer the shared_ptr overload for repeated geometry
+	Object(const Mesh& mesh, const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale)
+		: Object(std::make_shared<const Mesh>(mesh), position, rotation, scale) {}
 
 	void update();
 	void translate(const glm::vec3& translation);
@@ -51,28 +58,46 @@ public:
 	void setPosition(const glm::vec3& newPosition);
 	void setRotation(const glm::vec3& newRotation);
 	void setScale(const glm::vec3& newScale);
-    std::string getName() const { return mesh.getName(); }
+    std::string getName() const { return getMesh().getName(); }
 	glm::vec3 getPosition() const { return position; }
 	glm::vec3 getRotation() const { return rotation; }
 	glm::vec3 getScale() const { return scale; }
 	glm::mat4 getMatrix() const { return matrix; }
+	const glm::mat4& getInverseMatrix() const { return inverseMatrix; }
 
 	void setMesh(const std::string& meshPath);
-	Mesh& getMesh() { return mesh; }
-    // update matrix, apply to vertices, create triangles with material
+	void setMesh(std::shared_ptr<const Mesh> newMesh) { mesh = std::move(newMesh); }
+	const Mesh& getMesh() const;
+	const std::shared_ptr<const Mesh>& getMeshAsset() const { return mesh; }
+	AABB getWorldBounds() const;
+    // update matrix; mesh data is shared and never baked per object
     void updateMesh(); 
 
+	// Ray against the instanced mesh: the ray goes to local space, the hit comes back
+	bool intersectMesh(const Ray& ray, Intersection& isect) const;
+	bool occludesMesh(const Ray& ray) const;
+
 	void setAsPrimitive(Object::PrimitiveType PrimitiveType);
 
 	bool hasMaterial() const { return material != nullptr; }
 	std::shared_ptr<Material> getMaterial() const { return material; }
     void setMaterial(const std::shared_ptr<Material>& m) { material = m; }
+	MaterialId getMaterialId() const { return materialId; }
+	// Set by Scene when the material is registered
+	void setMaterialId(MaterialId id) { materialId = id; }
 
 	virtual bool intersect(const Ray& ray, Intersection& isect) const {return false;}
 };
 
 class GenericObject : public Object {
 public:
+    GenericObject(std::shared_ptr<const Mesh> mesh, const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale,
+                  const std::shared_ptr<Material>& mat)
+        : Object(std::move(mesh), position, rotation, scale) {
+        isPrimitive = false; // 标记为非原始物体
+        material = mat;
+        updateMesh();
+    }
     GenericObject(const Mesh& mesh, const glm::vec3& position, const glm::vec3& rotation, const glm::vec3& scale, 
                   const std::shared_ptr<Material>& mat)
         : Object(mesh, position, rotation, scale) {
@@ -81,7 +106,7 @@ public:
         updateMesh(); 
     }
     
-    // iterate through all triangles to look for intersection
+    // mesh BVH of the shared asset
     virtual bool intersect(const Ray& ray, Intersection& isect) const override;
 };
 
@@ -91,7 +116,7 @@ private:
     
 public:
     Sphere(const glm::vec3& position, float r, const Material& m)
-		: Object(Mesh(), position, glm::vec3(0.0f), glm::vec3(1.0f)), radius(r) {
+		: Object(nullptr, position, glm::vec3(0.0f), glm::vec3(1.0f)), radius(r) {
 		setMaterial(std::make_shared<Material>(m));
         setAsPrimitive(Object::PrimitiveType::SPHERE); // Mark as primitive
         updateRadius();
@@ -111,7 +136,7 @@ class Plane : public Object {
 glm::vec3 normal;
 public:
     Plane(const glm::vec3& position, const glm::vec3& normal, const Material& m)
-        : Object(Mesh(), position, glm::vec3(0.0f), glm::vec3(1.0f)), normal(normal) {
+        : Object(nullptr, position, glm::vec3(0.0f), glm::vec3(1.0f)), normal(normal) {
         updateRotation();
         setMaterial(std::make_shared<Material>(m));
         setAsPrimitive(Object::PrimitiveType::PLANE); // Mark as primitive
@@ -125,7 +150,7 @@ public:
 class Cube : public Object {
 public:
     Cube(const glm::vec3& position, const glm::vec3& scale, const Material& m)
-        : Object(Mesh(), position, glm::vec3(0.0f), scale) {
+        : Object(nullptr, position, glm::vec3(0.0f), scale) {
         setMaterial(std::make_shared<Material>(m));
         setAsPrimitive(Object::PrimitiveType::CUBE); // Mark as primitive
         updateMesh();
@@ -142,7 +167,7 @@ private:
 
 public:
     Cylinder(const glm::vec3& position, float r, float h, const Material& m)
-        : Object(Mesh(), position, glm::vec3(0.0f), glm::vec3(1.0f)), radius(r), height(h) {
+        : Object(nullptr, position, glm::vec3(0.0f), glm::vec3(1.0f)), radius(r), height(h) {
         setMaterial(std::make_shared<Material>(m));
         setAsPrimitive(Object::PrimitiveType::CYLINDER); // Mark as primitive
         updateParameters();
@@ -166,7 +191,7 @@ private:
 
 public:
     Cone(const glm::vec3& position, float r, float h, const Material& m)
-        : Object(Mesh(), position, glm::vec3(0.0f), glm::vec3(1.0f)), radius(r), height(h) {
+        : Object(nullptr, position, glm::vec3(0.0f), glm::vec3(1.0f)), radius(r), height(h) {
         setMaterial(std::make_shared<Material>(m));
         setAsPrimitive(Object::PrimitiveType::CONE); // Mark as primitive
         updateMesh();
@@ -189,7 +214,7 @@ private:
 
 public:
     Torus(const glm::vec3& position, float majorR, float minorR, const Material& m)
-        : Object(Mesh(), position, glm::vec3(0.0f), glm::vec3(1.0f)), majorRadius(majorR), minorRadius(minorR) {
+        : Object(nullptr, position, glm::vec3(0.0f), glm::vec3(1.0f)), majorRadius(majorR), minorRadius(minorR) {
         setMaterial(std::make_shared<Material>(m));
         setAsPrimitive(Object::PrimitiveType::TORUS); // Mark as primitive
         updateMesh();
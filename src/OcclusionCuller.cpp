@@ -0,0 +1,103 @@
+#include "OcclusionCuller.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void OcclusionCuller::update(const Buffer<float>& depth, const glm::mat4& viewProjectionMatrix) {
+    screenWidth = depth.width;
+    screenHeight = depth.height;
+    const int cellsX = (screenWidth + CELL - 1) / CELL;
+    const int cellsY = (screenHeight + CELL - 1) / CELL;
+    if (history.width != cellsX || history.height != cellsY) {
+        history = Buffer<float>(cellsX, cellsY);
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int cy = 0; cy < cellsY; ++cy) {
+        const int y1 = std::min((cy + 1) * CELL, screenHeight);
+        for (int cx = 0; cx < cellsX; ++cx) {
+            const int x1 = std::min((cx + 1) * CELL, screenWidth);
+            float farthest = 0.0f;
+            for (int y = cy * CELL; y < y1; ++y) {
+                for (int x = cx * CELL; x < x1; ++x) {
+                    farthest = std::max(farthest, depth(x, y));
+                }
+            }
+            history(cx, cy) = farthest;
+        }
+    }
+
+    occluders = history;
+    historyInvViewProjection = glm::inverse(viewProjectionMatrix);
+    historyValid = true;
+}
+
+bool OcclusionCuller::reproject(const glm::mat4& viewProjectionMatrix, int width, int height) {
+    if (!historyValid || width != screenWidth || height != screenHeight) {
+        return false;
+    }
+
+    // 把上一帧每个格子的中心按其最远深度反投影到世界空间，再投影到当前视角。
+    // 多个格子落到同一格时取最远值，保持保守
+    constexpr float EMPTY = std::numeric_limits<float>::lowest();
+    const float background = std::numeric_limits<float>::max();
+    occluders = Buffer<float>(history.width, history.height);
+    occluders.clear(EMPTY);
+    for (int cy = 0; cy < history.height; ++cy) {
+        for (int cx = 0; cx < history.width; ++cx) {
+            const float depth = history(cx, cy);
+            if (depth >= background) continue; // 有背景像素的格子不遮挡任何东西
+
+            const float px = std::min((cx + 0.5f) * CELL, static_cast<float>(screenWidth));
+            const float py = std::min((cy + 0.5f) * CELL, static_cast<float>(screenHeight));
+            glm::vec4 ndc(px / screenWidth * 2.0f - 1.0f, 1.0f - py / screenHeight * 2.0f, depth * 2.0f - 1.0f, 1.0f);
+            glm::vec4 world = historyInvViewProjection * ndc;
+            glm::vec4 clip = viewProjectionMatrix * (world / world.w);
+            if (clip.w < EPSILON) continue;
+
+            glm::vec3 p = glm::vec3(clip) / clip.w;
+            int x = static_cast<int>(std::floor((p.x + 1.0f) * 0.5f * screenWidth / CELL));
+            int y = static_cast<int>(std::floor((1.0f - p.y) * 0.5f * screenHeight / CELL));
+            if (x < 0 || y < 0 || x >= occluders.width || y >= occluders.height) continue;
+            float& cell = occluders(x, y);
+            cell = std::max(cell, (p.z + 1.0f) * 0.5f);
+        }
+    }
+    for (float& cell : occluders.pixels) {
+        if (cell == EMPTY) cell = background;
+    }
+    return true;
+}
+
+bool OcclusionCuller::isVisible(const AABB& bounds, const glm::mat4& mvp) const {
+    if (occluders.pixels.empty()) return true;
+
+    float minX = std::numeric_limits<float>::max(), maxX = std::numeric_limits<float>::lowest();
+    float minY = minX, maxY = maxX;
+    float nearest = std::numeric_limits<float>::max();
+    for (int corner = 0; corner < 8; ++corner) {
+        glm::vec3 p((corner & 1) ? bounds.maxBounds.x : bounds.minBounds.x,
+                    (corner & 2) ? bounds.maxBounds.y : bounds.minBounds.y,
+                    (corner & 4) ? bounds.maxBounds.z : bounds.minBounds.z);
+        glm::vec4 clip = mvp * glm::vec4(p, 1.0f);
+        if (clip.w < EPSILON) return true; // 跨过近平面，无法给出屏幕矩形
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        minX = std::min(minX, ndc.x); maxX = std::max(maxX, ndc.x);
+        minY = std::min(minY, ndc.y); maxY = std::max(maxY, ndc.y);
+        nearest = std::min(nearest, (ndc.z + 1.0f) * 0.5f);
+    }
+
+    const int x0 = std::max(0, static_cast<int>((minX + 1.0f) * 0.5f * screenWidth) / CELL);
+    const int x1 = std::min(occluders.width - 1, static_cast<int>((maxX + 1.0f) * 0.5f * screenWidth) / CELL);
+    const int y0 = std::max(0, static_cast<int>((1.0f - maxY) * 0.5f * screenHeight) / CELL);
+    const int y1 = std::min(occluders.height - 1, static_cast<int>((1.0f - minY) * 0.5f * screenHeight) / CELL);
+    if (x0 > x1 || y0 > y1) return true;
+
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            if (occluders(x, y) >= nearest) return true;
+        }
+    }
+    return false;
+}
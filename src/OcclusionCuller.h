@@ -0,0 +1,38 @@
+#pragma once
+
+#include "BVH.h"
+#include "Buffer.h"
+#include "MyMath.h"
+
+// Software occlusion culling against a low resolution max-depth buffer.
+//
+// Each cell keeps the farthest depth of the CELL x CELL pixels it covers, so a
+// bounding box whose nearest depth lies behind every cell it overlaps is hidden.
+// At the start of a frame last frame's cells are forward-reprojected into the new
+// view; cells nothing lands on stay empty (never occlude). Reprojection can miss
+// newly exposed geometry, so culled objects are re-tested with update() once the
+// visible set has been drawn (see Renderer::_drawCameraPass).
+class OcclusionCuller {
+public:
+    static constexpr int CELL = 8;
+
+    // Builds the cells from a full resolution depth buffer. They become both the
+    // current test target and the history reprojected by the next frame.
+    void update(const Buffer<float>& depth, const glm::mat4& viewProjectionMatrix);
+
+    // Reprojects the history into viewProjectionMatrix. Returns false when there is
+    // no usable history (first frame, resize), in which case nothing may be culled.
+    bool reproject(const glm::mat4& viewProjectionMatrix, int width, int height);
+
+    // Conservative: true unless the box is behind the stored depth everywhere it covers
+    bool isVisible(const AABB& bounds, const glm::mat4& mvp) const;
+
+    void invalidate() { historyValid = false; }
+
+private:
+    int screenWidth = 0, screenHeight = 0;
+    Buffer<float> history;               // max depth per cell of the last update()
+    glm::mat4 historyInvViewProjection{ 1.0f };
+    bool historyValid = false;
+    Buffer<float> occluders;             // cells isVisible() tests against
+};
@@ -0,0 +1,356 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RASTER_USE_SSE 1
+#endif
+
+#include "Material.h"
+#include "MyMath.h"
+#include "Vertex.h"
+
+// Screen-space triangle after vertex shading, clipping and viewport transform
+struct RasterTriangle {
+    VertexShaderOutput v[3];
+    glm::vec3 s[3];                     // screen-space position, counter-clockwise
+    float area = 0.0f;                  // 2x signed area, always > 0
+    MaterialId materialId = INVALID_MATERIAL; // INVALID_MATERIAL marks an empty slot
+    bool micro = false;                 // at most 2x2 candidate samples, drawn by rasterizeMicroTriangle
+};
+
+// Largest depth in an N x N group of depth values stored with a row stride of `stride`
+template <int N>
+inline float maxDepth(const float* depth, int stride) {
+#ifdef RASTER_USE_SSE
+    __m128 m = _mm_loadu_ps(depth);
+    for (int row = 0; row < N; ++row) {
+        for (int col = 0; col < N; col += 4) {
+            m = _mm_max_ps(m, _mm_loadu_ps(depth + row * stride + col));
+        }
+    }
+    m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+    m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(m);
+#else
+    float m = depth[0];
+    for (int row = 0; row < N; ++row) {
+        for (int col = 0; col < N; ++col) {
+            m = std::max(m, depth[row * stride + col]);
+        }
+    }
+    return m;
+#endif
+}
+
+// Tile-local depth/color storage owned by one worker during rasterization
+struct RasterTile {
+    static constexpr int SIZE = 64;
+    static constexpr int BLOCK = 4;    // pixels are tested in BLOCK x BLOCK groups
+    static constexpr int HIZ_CELL = 8; // hierarchical Z keeps one max depth per HIZ_CELL x HIZ_CELL pixels
+    static constexpr int HIZ_SIZE = SIZE / HIZ_CELL;
+    static_assert(HIZ_SIZE * HIZ_SIZE <= 64, "hiZDirty holds one bit per cell");
+
+    int x0, y0, x1, y1; // pixel bounds [x0, x1) x [y0, y1)
+    float depth[SIZE * SIZE];
+    uint32_t color[SIZE * SIZE];
+
+    // Max depth per cell. Depth only ever decreases, so a stale value is still a
+    // conservative bound; cells written since the last refresh are marked dirty.
+    float hiZ[HIZ_SIZE * HIZ_SIZE];
+    uint64_t hiZDirty = 0;
+
+    void buildHiZ() {
+        hiZDirty = ~0ull;
+        refreshHiZ();
+    }
+
+    void refreshHiZ() {
+        while (hiZDirty) {
+            int cell = 0;
+            while (!(hiZDirty & (1ull << cell))) ++cell;
+            hiZDirty &= hiZDirty - 1;
+            int cx = cell % HIZ_SIZE, cy = cell / HIZ_SIZE;
+            hiZ[cell] = maxDepth<HIZ_CELL>(&depth[cy * HIZ_CELL * SIZE + cx * HIZ_CELL], SIZE);
+        }
+    }
+};
+
+// Edge functions E_i(x, y) = A_i * x + B_i * y + C_i, evaluated in fixed point on
+// vertices snapped to 1/SUBPIXEL of a pixel. Edge i is opposite vertex i, so
+// E_i / area is the barycentric weight of vertex i; (A_i, B_i) points inside.
+// Values reach ~2^44 for guard-band sized triangles, hence 64-bit accumulators.
+//
+// Top-left fill rule: a sample exactly on an edge belongs to the triangle only if
+// the edge is a left edge (A > 0) or a top edge (A == 0, B > 0 with y pointing
+// down). Other edges carry a -1 bias, so `E >= 0` is the coverage test for all
+// three and pixels on shared edges are drawn exactly once.
+struct EdgeSetup {
+    static constexpr int SUBPIXEL_BITS = 8;
+    static constexpr int SUBPIXEL = 1 << SUBPIXEL_BITS;
+
+    int32_t X[3], Y[3];        // snapped vertex positions
+    int64_t A[3], B[3];        // per-pixel steps are A << SUBPIXEL_BITS, B << SUBPIXEL_BITS
+    int64_t bias[3];           // 0 for top-left edges, -1 otherwise
+    int64_t area = 0;          // E0 + E1 + E2, 2x area in sub-pixel units; <= 0 when degenerate after snapping
+    float invArea = 0.0f;
+    float z[3];
+
+    // Biased edge values at the center of pixel (x, y)
+    void evaluate(int x, int y, int64_t e[3]) const {
+        const int64_t px = (int64_t(x) << SUBPIXEL_BITS) + SUBPIXEL / 2;
+        const int64_t py = (int64_t(y) << SUBPIXEL_BITS) + SUBPIXEL / 2;
+        for (int i = 0; i < 3; ++i) {
+            const int p = (i + 1) % 3;
+            e[i] = A[i] * (px - X[p]) + B[i] * (py - Y[p]) + bias[i];
+        }
+    }
+
+    float depthAt(const int64_t e[3]) const {
+        return (float(e[0]) * z[0] + float(e[1]) * z[1] + float(e[2]) * z[2]) * invArea;
+    }
+};
+
+inline EdgeSetup setupEdges(const RasterTriangle& tri) {
+    EdgeSetup e;
+    for (int i = 0; i < 3; ++i) {
+        e.X[i] = (int32_t)std::lround(tri.s[i].x * EdgeSetup::SUBPIXEL);
+        e.Y[i] = (int32_t)std::lround(tri.s[i].y * EdgeSetup::SUBPIXEL);
+        e.z[i] = tri.s[i].z;
+    }
+    for (int i = 0; i < 3; ++i) {
+        const int p = (i + 1) % 3;
+        const int q = (i + 2) % 3;
+        e.A[i] = int64_t(e.Y[p]) - e.Y[q];
+        e.B[i] = int64_t(e.X[q]) - e.X[p];
+        const bool topLeft = e.A[i] > 0 || (e.A[i] == 0 && e.B[i] > 0);
+        e.bias[i] = topLeft ? 0 : -1;
+    }
+    e.area = e.A[0] * (int64_t(e.X[0]) - e.X[1]) + e.B[0] * (int64_t(e.Y[0]) - e.Y[1]);
+    e.invArea = e.area > 0 ? 1.0f / float(e.area) : 0.0f;
+    return e;
+}
+
+// Pixels whose centers lie inside the triangle's snapped bounding box: columns
+// [x0, x1], rows [y0, y1]. Empty (x0 > x1 or y0 > y1) means the triangle cannot
+// cover any sample. Uses the same snapping as setupEdges, so it is exact.
+struct SampleBounds {
+    int x0, y0, x1, y1;
+    int width() const { return x1 - x0 + 1; }
+    int height() const { return y1 - y0 + 1; }
+    bool empty() const { return x0 > x1 || y0 > y1; }
+};
+
+inline SampleBounds sampleBounds(const RasterTriangle& tri) {
+    constexpr int HALF = EdgeSetup::SUBPIXEL / 2;
+    int32_t minX = INT32_MAX, maxX = INT32_MIN, minY = INT32_MAX, maxY = INT32_MIN;
+    for (int i = 0; i < 3; ++i) {
+        const int32_t x = (int32_t)std::lround(tri.s[i].x * EdgeSetup::SUBPIXEL);
+        const int32_t y = (int32_t)std::lround(tri.s[i].y * EdgeSetup::SUBPIXEL);
+        minX = std::min(minX, x); maxX = std::max(maxX, x);
+        minY = std::min(minY, y); maxY = std::max(maxY, y);
+    }
+    // first / last n with n * SUBPIXEL + HALF inside [min, max]; >> floors negatives too
+    return { (minX - HALF + EdgeSetup::SUBPIXEL - 1) >> EdgeSetup::SUBPIXEL_BITS,
+             (minY - HALF + EdgeSetup::SUBPIXEL - 1) >> EdgeSetup::SUBPIXEL_BITS,
+             (maxX - HALF) >> EdgeSetup::SUBPIXEL_BITS,
+             (maxY - HALF) >> EdgeSetup::SUBPIXEL_BITS };
+}
+
+// Screen-space barycentrics of the point (px, py), e.g. a pixel center
+inline glm::vec3 barycentricAt(const RasterTriangle& tri, float px, float py) {
+    glm::vec3 bary;
+    for (int i = 0; i < 3; ++i) {
+        const glm::vec3& p = tri.s[(i + 1) % 3];
+        const glm::vec3& q = tri.s[(i + 2) % 3];
+        bary[i] = (q.x - p.x) * (py - p.y) - (q.y - p.y) * (px - p.x);
+    }
+    return bary / tri.area;
+}
+
+// Evaluates one 4-pixel row: writes the depth of every lane and returns the bitmask
+// of lanes that are covered and pass the depth test. Coverage is the sign of the
+// OR of the three 64-bit edge values, so no 64-bit compare is needed.
+inline int rasterizeRow4(const int64_t rowE[3], const int64_t stepX[3], float rowZ, float zStepX,
+                         const float* depth, bool testEdges, float laneZ[4]) {
+    int covered = 0xF;
+    if (testEdges) {
+        covered = 0;
+        for (int lane = 0; lane < 4; ++lane) {
+            int64_t signs = (rowE[0] + stepX[0] * lane) | (rowE[1] + stepX[1] * lane) | (rowE[2] + stepX[2] * lane);
+            covered |= (signs >= 0) << lane;
+        }
+    }
+#ifdef RASTER_USE_SSE
+    const __m128 laneOffset = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    __m128 z = _mm_add_ps(_mm_set1_ps(rowZ), _mm_mul_ps(_mm_set1_ps(zStepX), laneOffset));
+    _mm_storeu_ps(laneZ, z);
+    return covered & _mm_movemask_ps(_mm_cmplt_ps(z, _mm_loadu_ps(depth)));
+#else
+    int mask = 0;
+    for (int lane = 0; lane < 4; ++lane) {
+        laneZ[lane] = rowZ + zStepX * lane;
+        if (laneZ[lane] < depth[lane]) {
+            mask |= 1 << lane;
+        }
+    }
+    return covered & mask;
+#endif
+}
+
+// Fast path for triangles flagged `micro` at setup: no block walk and no
+// hierarchical Z, the edge functions are evaluated directly at the one to four
+// candidate pixel centers.
+template <typename FragmentFn>
+inline void rasterizeMicroTriangle(const RasterTriangle& tri, RasterTile& tile, FragmentFn&& fragment) {
+    const SampleBounds samples = sampleBounds(tri);
+    const int x0 = std::max(samples.x0, tile.x0), x1 = std::min(samples.x1, tile.x1 - 1);
+    const int y0 = std::max(samples.y0, tile.y0), y1 = std::min(samples.y1, tile.y1 - 1);
+    if (x0 > x1 || y0 > y1) return;
+
+    const EdgeSetup edges = setupEdges(tri);
+    if (edges.area <= 0) return;
+
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            int64_t e[3];
+            edges.evaluate(x, y, e);
+            if ((e[0] | e[1] | e[2]) < 0) continue;
+
+            const int lx = x - tile.x0, ly = y - tile.y0;
+            const int idx = ly * RasterTile::SIZE + lx;
+            const float z = edges.depthAt(e);
+            if (!(z < tile.depth[idx])) continue;
+
+            tile.depth[idx] = z;
+            tile.hiZDirty |= 1ull << ((ly / RasterTile::HIZ_CELL) * RasterTile::HIZ_SIZE + lx / RasterTile::HIZ_CELL);
+            fragment(x, y, idx, float(e[0]) * edges.invArea, float(e[1]) * edges.invArea, float(e[2]) * edges.invArea);
+        }
+    }
+    tile.refreshHiZ();
+}
+
+// Shared rasterization kernel. Walks the triangle's bounding box inside the tile in
+// 4x4 blocks, stepping the fixed-point edge functions incrementally. The whole
+// triangle, or any block of it, that lies behind the tile's hierarchical Z is
+// rejected before any per-pixel work, as are blocks entirely outside an edge;
+// blocks entirely inside all edges skip the per-pixel coverage test. Each visible
+// pixel has its depth written and is handed to
+//     fragment(x, y, tileIdx, b0, b1, b2)
+// with b0..b2 the screen-space barycentrics of the triangle's vertices.
+template <typename FragmentFn>
+inline void rasterizeTriangle(const RasterTriangle& tri, RasterTile& tile, FragmentFn&& fragment) {
+    if (tri.micro) {
+        rasterizeMicroTriangle(tri, tile, fragment);
+        return;
+    }
+    constexpr int BLOCK = RasterTile::BLOCK;
+    const glm::vec3& s0 = tri.s[0];
+    const glm::vec3& s1 = tri.s[1];
+    const glm::vec3& s2 = tri.s[2];
+
+    int minX = std::max(tile.x0, (int)std::floor(std::min({ s0.x, s1.x, s2.x })));
+    int maxX = std::min(tile.x1 - 1, (int)std::ceil(std::max({ s0.x, s1.x, s2.x })));
+    int minY = std::max(tile.y0, (int)std::floor(std::min({ s0.y, s1.y, s2.y })));
+    int maxY = std::min(tile.y1 - 1, (int)std::ceil(std::max({ s0.y, s1.y, s2.y })));
+    if (minX > maxX || minY > maxY) return;
+
+    // Whole-triangle occlusion test against the coarse depth of the cells it touches
+    const float triMinZ = std::min({ s0.z, s1.z, s2.z });
+    float coveredMaxZ = std::numeric_limits<float>::lowest();
+    for (int cy = (minY - tile.y0) / RasterTile::HIZ_CELL; cy <= (maxY - tile.y0) / RasterTile::HIZ_CELL; ++cy) {
+        for (int cx = (minX - tile.x0) / RasterTile::HIZ_CELL; cx <= (maxX - tile.x0) / RasterTile::HIZ_CELL; ++cx) {
+            coveredMaxZ = std::max(coveredMaxZ, tile.hiZ[cy * RasterTile::HIZ_SIZE + cx]);
+        }
+    }
+    if (triMinZ >= coveredMaxZ) return;
+
+    const EdgeSetup edges = setupEdges(tri);
+    if (edges.area <= 0) return; // 吸附到子像素网格后退化
+
+    // Per-pixel steps and offsets from a block's first pixel center to its extreme corners, per edge
+    int64_t stepX[3], stepY[3], blockMaxOffset[3], blockMinOffset[3];
+    for (int i = 0; i < 3; ++i) {
+        stepX[i] = edges.A[i] * EdgeSetup::SUBPIXEL;
+        stepY[i] = edges.B[i] * EdgeSetup::SUBPIXEL;
+        int64_t dx = stepX[i] * (BLOCK - 1);
+        int64_t dy = stepY[i] * (BLOCK - 1);
+        blockMaxOffset[i] = std::max<int64_t>(dx, 0) + std::max<int64_t>(dy, 0);
+        blockMinOffset[i] = std::min<int64_t>(dx, 0) + std::min<int64_t>(dy, 0);
+    }
+
+    // Blocks are aligned to the tile so tile-local rows stay contiguous
+    const int bx0 = tile.x0 + ((minX - tile.x0) & ~(BLOCK - 1));
+    const int by0 = tile.y0 + ((minY - tile.y0) & ~(BLOCK - 1));
+
+    // Depth stays a float plane; its gradients come from the same snapped edges
+    int64_t rowE[3];
+    edges.evaluate(bx0, by0, rowE);
+    float rowZ = edges.depthAt(rowE);
+    const float zStepX = (float(stepX[0]) * edges.z[0] + float(stepX[1]) * edges.z[1] + float(stepX[2]) * edges.z[2]) * edges.invArea;
+    const float zStepY = (float(stepY[0]) * edges.z[0] + float(stepY[1]) * edges.z[1] + float(stepY[2]) * edges.z[2]) * edges.invArea;
+    const float zMinOffset = std::min(zStepX * (BLOCK - 1), 0.0f) + std::min(zStepY * (BLOCK - 1), 0.0f);
+
+    float laneZ[4];
+    for (int by = by0; by <= maxY; by += BLOCK) {
+        int64_t blockE[3] = { rowE[0], rowE[1], rowE[2] };
+        float blockZ = rowZ;
+        const int rows = std::min(BLOCK, tile.y1 - by);
+
+        for (int bx = bx0; bx <= maxX; bx += BLOCK) {
+            bool outside = false;
+            bool inside = true;
+            for (int i = 0; i < 3; ++i) {
+                outside = outside || blockE[i] + blockMaxOffset[i] < 0;
+                inside = inside && blockE[i] + blockMinOffset[i] >= 0;
+            }
+
+            const int lx = bx - tile.x0, ly = by - tile.y0;
+            const int cell = (ly / RasterTile::HIZ_CELL) * RasterTile::HIZ_SIZE + lx / RasterTile::HIZ_CELL;
+            if (!outside && blockZ + zMinOffset < tile.hiZ[cell]) {
+                const int blockIdx = ly * RasterTile::SIZE + lx;
+                const int columnMask = (1 << std::min(BLOCK, tile.x1 - bx)) - 1;
+                int64_t pixelE[3] = { blockE[0], blockE[1], blockE[2] };
+                float pixelZ = blockZ;
+
+                for (int row = 0; row < rows; ++row) {
+                    int rowIdx = blockIdx + row * RasterTile::SIZE;
+                    int mask = rasterizeRow4(pixelE, stepX, pixelZ, zStepX, &tile.depth[rowIdx], !inside, laneZ) & columnMask;
+                    if (mask) {
+                        tile.hiZDirty |= 1ull << cell;
+                    }
+                    while (mask) {
+                        int lane = 0;
+                        while (!(mask & (1 << lane))) ++lane;
+                        mask &= mask - 1;
+
+                        tile.depth[rowIdx + lane] = laneZ[lane];
+                        fragment(bx + lane, by + row, rowIdx + lane,
+                            float(pixelE[0] + stepX[0] * lane) * edges.invArea,
+                            float(pixelE[1] + stepX[1] * lane) * edges.invArea,
+                            float(pixelE[2] + stepX[2] * lane) * edges.invArea);
+                    }
+                    for (int i = 0; i < 3; ++i) {
+                        pixelE[i] += stepY[i];
+                    }
+                    pixelZ += zStepY;
+                }
+            }
+
+            for (int i = 0; i < 3; ++i) {
+                blockE[i] += stepX[i] * BLOCK;
+            }
+            blockZ += zStepX * BLOCK;
+        }
+
+        for (int i = 0; i < 3; ++i) {
+            rowE[i] += stepY[i] * BLOCK;
+        }
+        rowZ += zStepY * BLOCK;
+    }
+    tile.refreshHiZ();
+}
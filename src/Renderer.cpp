@@ -1,6 +1,7 @@
 #include "Renderer.h"
 
-#include <array>   // Include <array> for std::array usage
+#include <algorithm>
+#include <type_traits>
 #include <typeinfo>
 #include <random>  // For SSAO/SSGI random sampling
 #include "Color.h"
@@ -16,30 +17,12 @@
 
 void Renderer::clearBuffers() {
 	framebuffer.clear(0xFF000000);
+	hdrBuffer.clear(glm::vec3(0.0f));
 	zbuffer.clear(std::numeric_limits<float>::max());  // Clear depth buffer to max depth
-	shadowMap.clear(std::numeric_limits<float>::max()); // Clear shadow map to max depth
+	visibilityBuffer.clear(INVALID_TRIANGLE);
 	
 	// Clear G-Buffer
-	gBufferPosition.clear(glm::vec3(0.0f));
-	gBufferNormal.clear(glm::vec3(0.0f));
-	gBufferAlbedo.clear(glm::vec3(0.0f));
-	gBufferColor.clear(0xFF000000);
-}
-// w is world position
-bool Renderer::_isBackFacingViewSpace(
-    const glm::vec3& w0, const glm::vec3& w1, const glm::vec3& w2,
-    const glm::vec3& cameraPosition)
-{
-    glm::vec3 faceNormal = glm::normalize(glm::cross(w1 - w0, w2 - w0));
-    glm::vec3 toCamera = glm::normalize(cameraPosition - w0);
-    return glm::dot(faceNormal, toCamera) < 0.0f; // 背向摄像机则为 true
-}
-
-
-bool Renderer::_insideTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
-    return (glm::cross(b - a, p - a).z >= 0.0f &&
-            glm::cross(c - b, p - b).z >= 0.0f &&
-            glm::cross(a - c, p - c).z >= 0.0f);
+	gBuffer.clear();
 }
 
 std::vector<glm::vec3> Renderer::clipToScreen(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, int screenWidth, int screenHeight) {
@@ -68,6 +51,107 @@ VertexShaderOutput vertexShader(const Vertex& in, const glm::mat4& model, const
     return out;
 }
 
+// Runs the vertex shader over every vertex of a mesh once, PACKET vertices at a time
+void vertexShaderBatch(const std::vector<Vertex>& in, const glm::mat4& model, const glm::mat3& normalMat, const glm::mat4& mvp,
+    VertexShaderOutputSoA& out) {
+    constexpr int PACKET = static_cast<int>(VertexShaderOutputSoA::PACKET);
+    const int count = static_cast<int>(in.size());
+    out.resize(in.size());
+    if (count == 0) return;
+    const int packets = (count + PACKET - 1) / PACKET;
+
+    #pragma omp parallel for schedule(static)
+    for (int p = 0; p < packets; ++p) {
+        const int base = p * PACKET;
+#ifdef RASTER_USE_SSE
+        // the tail packet repeats the last vertex; its lanes land in the padding
+        const Vertex* v[4];
+        for (int lane = 0; lane < 4; ++lane) {
+            v[lane] = &in[std::min(base + lane, count - 1)];
+        }
+        const __m128 px = _mm_set_ps(v[3]->localPos.x, v[2]->localPos.x, v[1]->localPos.x, v[0]->localPos.x);
+        const __m128 py = _mm_set_ps(v[3]->localPos.y, v[2]->localPos.y, v[1]->localPos.y, v[0]->localPos.y);
+        const __m128 pz = _mm_set_ps(v[3]->localPos.z, v[2]->localPos.z, v[1]->localPos.z, v[0]->localPos.z);
+        const __m128 nx = _mm_set_ps(v[3]->normal.x, v[2]->normal.x, v[1]->normal.x, v[0]->normal.x);
+        const __m128 ny = _mm_set_ps(v[3]->normal.y, v[2]->normal.y, v[1]->normal.y, v[0]->normal.y);
+        const __m128 nz = _mm_set_ps(v[3]->normal.z, v[2]->normal.z, v[1]->normal.z, v[0]->normal.z);
+
+        // row k of m * (p, 1)
+        auto transformPoint = [&](const glm::mat4& m, int k) {
+            return _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0][k]), px), _mm_mul_ps(_mm_set1_ps(m[1][k]), py)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[2][k]), pz), _mm_set1_ps(m[3][k])));
+        };
+        _mm_storeu_ps(&out.clipX[base], transformPoint(mvp, 0));
+        _mm_storeu_ps(&out.clipY[base], transformPoint(mvp, 1));
+        _mm_storeu_ps(&out.clipZ[base], transformPoint(mvp, 2));
+        _mm_storeu_ps(&out.clipW[base], transformPoint(mvp, 3));
+        _mm_storeu_ps(&out.worldX[base], transformPoint(model, 0));
+        _mm_storeu_ps(&out.worldY[base], transformPoint(model, 1));
+        _mm_storeu_ps(&out.worldZ[base], transformPoint(model, 2));
+
+        // normalize(normalMat * normal)
+        __m128 wx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(normalMat[0][0]), nx), _mm_mul_ps(_mm_set1_ps(normalMat[1][0]), ny)), _mm_mul_ps(_mm_set1_ps(normalMat[2][0]), nz));
+        __m128 wy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(normalMat[0][1]), nx), _mm_mul_ps(_mm_set1_ps(normalMat[1][1]), ny)), _mm_mul_ps(_mm_set1_ps(normalMat[2][1]), nz));
+        __m128 wz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(normalMat[0][2]), nx), _mm_mul_ps(_mm_set1_ps(normalMat[1][2]), ny)), _mm_mul_ps(_mm_set1_ps(normalMat[2][2]), nz));
+        __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(wx, wx), _mm_mul_ps(wy, wy)), _mm_mul_ps(wz, wz)));
+        _mm_storeu_ps(&out.normalX[base], _mm_div_ps(wx, len));
+        _mm_storeu_ps(&out.normalY[base], _mm_div_ps(wy, len));
+        _mm_storeu_ps(&out.normalZ[base], _mm_div_ps(wz, len));
+
+        for (int lane = 0; lane < 4; ++lane) {
+            out.u[base + lane] = v[lane]->uv.x;
+            out.v[base + lane] = v[lane]->uv.y;
+        }
+#else
+        for (int i = base; i < std::min(base + PACKET, count); ++i) {
+            VertexShaderOutput o = vertexShader(in[i], model, normalMat, mvp);
+            out.clipX[i] = o.clipPos.x; out.clipY[i] = o.clipPos.y; out.clipZ[i] = o.clipPos.z; out.clipW[i] = o.clipPos.w;
+            out.worldX[i] = o.worldPos.x; out.worldY[i] = o.worldPos.y; out.worldZ[i] = o.worldPos.z;
+            out.normalX[i] = o.normal.x; out.normalY[i] = o.normal.y; out.normalZ[i] = o.normal.z;
+            out.u[i] = o.uv.x; out.v[i] = o.uv.y;
+        }
+#endif
+    }
+}
+
+// Depth-only vertex stage: clip positions and nothing else
+void positionShaderBatch(const std::vector<Vertex>& in, const glm::mat4& mvp, VertexShaderOutputSoA& out) {
+    constexpr int PACKET = static_cast<int>(VertexShaderOutputSoA::PACKET);
+    const int count = static_cast<int>(in.size());
+    out.resizePositions(in.size());
+    if (count == 0) return;
+    const int packets = (count + PACKET - 1) / PACKET;
+
+    #pragma omp parallel for schedule(static)
+    for (int p = 0; p < packets; ++p) {
+        const int base = p * PACKET;
+#ifdef RASTER_USE_SSE
+        const Vertex* v[4];
+        for (int lane = 0; lane < 4; ++lane) {
+            v[lane] = &in[std::min(base + lane, count - 1)];
+        }
+        const __m128 px = _mm_set_ps(v[3]->localPos.x, v[2]->localPos.x, v[1]->localPos.x, v[0]->localPos.x);
+        const __m128 py = _mm_set_ps(v[3]->localPos.y, v[2]->localPos.y, v[1]->localPos.y, v[0]->localPos.y);
+        const __m128 pz = _mm_set_ps(v[3]->localPos.z, v[2]->localPos.z, v[1]->localPos.z, v[0]->localPos.z);
+        auto transformPoint = [&](int k) {
+            return _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(mvp[0][k]), px), _mm_mul_ps(_mm_set1_ps(mvp[1][k]), py)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(mvp[2][k]), pz), _mm_set1_ps(mvp[3][k])));
+        };
+        _mm_storeu_ps(&out.clipX[base], transformPoint(0));
+        _mm_storeu_ps(&out.clipY[base], transformPoint(1));
+        _mm_storeu_ps(&out.clipZ[base], transformPoint(2));
+        _mm_storeu_ps(&out.clipW[base], transformPoint(3));
+#else
+        for (int i = base; i < std::min(base + PACKET, count); ++i) {
+            const glm::vec4 c = mvp * glm::vec4(in[i].localPos, 1.0f);
+            out.clipX[i] = c.x; out.clipY[i] = c.y; out.clipZ[i] = c.z; out.clipW[i] = c.w;
+        }
+#endif
+    }
+}
+
 VertexShaderOutput interpolate(const VertexShaderOutput& a, const VertexShaderOutput& b, float alpha) {
     VertexShaderOutput out;
     out.clipPos = glm::mix(a.clipPos, b.clipPos, alpha);
@@ -78,91 +162,65 @@ VertexShaderOutput interpolate(const VertexShaderOutput& a, const VertexShaderOu
     return out;
 }
 
-// v: vertex
-// s: point in screen space
-// w: world space position
-void Renderer::_drawTrianglePhong(
-    const VertexShaderOutput& v0, const VertexShaderOutput& v1, const VertexShaderOutput& v2,
-    const glm::vec3& s0, const glm::vec3& s1, const glm::vec3& s2,
-    const std::vector<std::shared_ptr< Light >>& lights, const Camera& camera, std::shared_ptr<Material> material) {
-    // if (w0 < EPSILON || w1 < EPSILON || w2 < EPSILON) {
-    //     // printf("skipped point: w0=%.2f, w1=%.2f, w2=%.2f\n", w0, w1, w2);
-    //     return; // 避免除以零
-    // }
+// Visibility pass: only depth and the triangle index are written per pixel
+void Renderer::_drawTriangleVisibility(uint32_t triIdx, RasterTile& tile) {
+    rasterizeTriangle(rasterTriangles[triIdx], tile, [&](int, int, int idx, float, float, float) {
+        tile.color[idx] = triIdx;
+    });
+}
 
-    // 保证顺时针方向，防止 area 负值带来插值错误
-    float area = glm::cross(s1 - s0, s2 - s0).z;
-    if (fabs(area) < EPSILON) {
-        // printf("Degenerate triangle: area=%.2f\n", area);
-        return; // 退化三角形
-    } // 退化三角形
-    if (area < 0.0f) {
-        _drawTrianglePhong(v0, v2, v1, s0, s2, s1, lights, camera, material);
-        return;
+// Resolve pass: every covered pixel is shaded exactly once from the triangle that
+// won the depth test, with barycentrics reconstructed at the pixel center.
+void Renderer::_resolvePhong(const Scene& scene) {
+    #pragma omp parallel for schedule(dynamic)
+    for (int y = 0; y < screenHeight; ++y) {
+        for (int x = 0; x < screenWidth; ++x) {
+            int idx = y * screenWidth + x;
+            uint32_t triIdx = visibilityBuffer[idx];
+            if (triIdx == INVALID_TRIANGLE) continue;
+
+            const RasterTriangle& tri = rasterTriangles[triIdx];
+            glm::vec3 bary = barycentricAt(tri, x + 0.5f, y + 0.5f);
+            hdrBuffer[idx] = _shadePhong(tri, bary, scene.getMaterial(tri.materialId), scene.lights, _lightsAt(x, y), frameCamera.position);
+        }
     }
+}
+
+glm::vec3 Renderer::_shadePhong(const RasterTriangle& tri, const glm::vec3& bary, const Material& material,
+    const std::vector<std::shared_ptr< Light >>& lights, const std::vector<uint32_t>& lightList, const glm::vec3& cameraPosition) const {
+    const VertexShaderOutput& v0 = tri.v[0];
+    const VertexShaderOutput& v1 = tri.v[1];
+    const VertexShaderOutput& v2 = tri.v[2];
+    float a = bary.x, b = bary.y, c = bary.z;
+
     float invW0 = 1.0f / v0.w;
     float invW1 = 1.0f / v1.w;
     float invW2 = 1.0f / v2.w;
-    glm::vec2 uv0_w = v0.uv * invW0;
-    glm::vec2 uv1_w = v1.uv * invW1;
-    glm::vec2 uv2_w = v2.uv * invW2;
-    glm::vec3 n0_w = v0.normal * invW0;
-    glm::vec3 n1_w = v1.normal * invW1;
-    glm::vec3 n2_w = v2.normal * invW2;
 
-    int minX = std::max(0, (int)std::floor(std::min({ s0.x, s1.x, s2.x })));
-    int maxX = std::min(screenWidth - 1, (int)std::ceil(std::max({ s0.x, s1.x, s2.x })));
-    int minY = std::max(0, (int)std::floor(std::min({ s0.y, s1.y, s2.y })));
-    int maxY = std::min(screenHeight - 1, (int)std::ceil(std::max({ s0.y, s1.y, s2.y })));
+    glm::vec3 pos = v0.worldPos * a + v1.worldPos * b + v2.worldPos * c;
+    glm::vec3 normal = glm::normalize(v0.normal * (invW0 * a) + v1.normal * (invW1 * b) + v2.normal * (invW2 * c));
 
-    for (int y = minY; y <= maxY; ++y) {
-        for (int x = minX; x <= maxX; ++x) {
-            glm::vec3 p(x + 0.5f, y + 0.5f, 0.0f);
-            if (_insideTriangle(p, s0, s1, s2)) {
-                float a = (glm::cross(s1 - p, s2 - p)).z / area;
-                float b = (glm::cross(s2 - p, s0 - p)).z / area;
-                float c = (glm::cross(s0 - p, s1 - p)).z / area;
-
-                float z = a * s0.z + b * s1.z + c * s2.z;
-                int idx = y * screenWidth + x;
-                
-                if (z < zbuffer[idx]) {
-                    zbuffer[idx] = z;
-                    glm::vec3 pos = v0.worldPos * a + v1.worldPos * b + v2.worldPos * c;
-                    glm::vec3 normal = glm::normalize(n0_w * a + n1_w * b + n2_w * c);
-
-                    // 透视修正插值 uv
-                    float invW = a * invW0 + b * invW1 + c * invW2;
-                    glm::vec2 uv = (a * uv0_w + b * uv1_w + c * uv2_w) / invW;
-                    glm::vec3 baseColor = material->sampleBaseColor(uv);
-                    glm::vec3 color = glm::vec3(0.0f);
-                    
-                    // Shadow mapping - 只对第一个光源应用阴影
-                    float shadowFactor = 1.0f;
-                    if (!lights.empty()) {
-                        shadowFactor = sampleShadowMap(pos);
-                    }
-                    
-                    for (size_t lightIdx = 0; lightIdx < lights.size(); ++lightIdx) {
-                        const auto& light = lights[lightIdx];
-                        if (light->getDistance(pos) < EPSILON) continue; // 避免光源距离过近
-                        
-                        glm::vec3 lightContribution = material->computePhong(
-                            normal, uv, camera.getPosition() - pos, light->getDirection(pos), light->getColor());
-                        
-                        // 只对第一个光源应用阴影
-                        if (lightIdx == 0) {
-                            lightContribution *= shadowFactor;
-                        }
-                        
-                        color += lightContribution;
-                    }
-                    color = glm::clamp(color, 0.0f, 1.0f); // 确保颜色在 [0, 1] 范围内
-                    framebuffer[idx] = Color::VecToUint32(color); // 映射 [-1,1] → [0,1]
-                }
-            }
-        }
+    // 透视修正插值 uv
+    float invW = a * invW0 + b * invW1 + c * invW2;
+    glm::vec2 uv = (v0.uv * (invW0 * a) + v1.uv * (invW1 * b) + v2.uv * (invW2 * c)) / invW;
+    glm::vec3 color = glm::vec3(0.0f);
+    
+    // 只遍历影响当前 tile 的光源
+    for (uint32_t lightIdx : lightList) {
+        const auto& light = lights[lightIdx];
+        if (light->getDistance(pos) < EPSILON) continue; // 避免光源距离过近
+        // tile 的光源列表按范围包围盒剔除，逐像素还要再判一次范围
+        const float window = light->rangeWindow(pos);
+        if (window <= 0.0f) continue;
+
+        glm::vec3 lightContribution = material.computePhong(
+            normal, uv, cameraPosition - pos, light->getDirection(pos), light->getColor());
+
+        lightContribution *= window * sampleShadow(lightIdx, pos, normal);
+        
+        color += lightContribution;
     }
+    return glm::max(color, glm::vec3(0.0f)); // 线性 HDR，上限交给 tone mapping
 }
 
 glm::vec3 Renderer::_computePhongColor(const glm::vec3& pos, const glm::vec3& normal, const std::shared_ptr<Light>& light, const glm::vec3& cameraPos, const glm::vec3& baseColor)
@@ -179,7 +237,7 @@ glm::vec3 Renderer::_computePhongColor(const glm::vec3& pos, const glm::vec3& no
 	glm::vec3 diffuse = diff * baseColor;
 	glm::vec3 specular = spec * glm::vec3{ 1,1,1 }; // white specular
 
-	glm::vec3 color = (ambient + diffuse + specular) * light->getIntensity(pos);
+	glm::vec3 color = (ambient + diffuse + specular) * (light->getIntensity(pos) * light->rangeWindow(pos));
 	return glm::clamp(color, 0.0f, 1.0f);
 }
 
@@ -190,116 +248,575 @@ glm::vec3 Renderer::sampleTexture(const std::vector<uint32_t>& textureData, glm:
 }
 
 glm::vec3 Renderer::ndcToScreen(const glm::vec3& ndc) const {
-    float x = (ndc.x + 1.0f) * 0.5f * screenWidth;
-    float y = (1.0f - ndc.y) * 0.5f * screenHeight; // 注意y翻转
+    return ndcToViewport(ndc, screenWidth, screenHeight);
+}
+
+glm::vec3 Renderer::ndcToViewport(const glm::vec3& ndc, int width, int height) {
+    float x = (ndc.x + 1.0f) * 0.5f * width;
+    float y = (1.0f - ndc.y) * 0.5f * height; // 注意y翻转
     float z = (ndc.z + 1.0f) * 0.5f; // depth: [0, 1] for z-buffer
     return glm::vec3(x, y, z);
 }
 
 
-void Renderer::clip_triangle_against_near_plane(
-    const VertexShaderOutput& v0, const VertexShaderOutput& v1, const VertexShaderOutput& v2,
-    std::vector<std::array<VertexShaderOutput, 3>>& clipped_tris)
-{
-    const VertexShaderOutput vertices[] = { v0, v1, v2 };
-    std::vector<VertexShaderOutput> inside_points;
-    std::vector<VertexShaderOutput> outside_points;
+// Clip-space plane distances, >= 0 inside. Plane 0 is the near plane (w = EPSILON),
+// planes 1-4 are the guard band |x|, |y| <= GUARD_BAND * w.
+static inline float clipDistance(const glm::vec4& p, int plane) {
+    switch (plane) {
+    case 0: return p.w - EPSILON;
+    case 1: return Renderer::GUARD_BAND * p.w + p.x;
+    case 2: return Renderer::GUARD_BAND * p.w - p.x;
+    case 3: return Renderer::GUARD_BAND * p.w + p.y;
+    default: return Renderer::GUARD_BAND * p.w - p.y;
+    }
+}
 
-    for (int i = 0; i < 3; ++i) {
-        if (vertices[i].clipPos.w >= EPSILON) {
-            inside_points.push_back(vertices[i]);
-        } else {
-            outside_points.push_back(vertices[i]);
+// Bit i set when the vertex is outside clip plane i
+static inline uint32_t guardBandOutcode(const glm::vec4& p) {
+    uint32_t code = 0;
+    for (int plane = 0; plane < Renderer::CLIP_PLANE_COUNT; ++plane) {
+        if (clipDistance(p, plane) < 0.0f) code |= 1u << plane;
+    }
+    return code;
+}
+
+// Bit set per viewport side the vertex lies beyond (the near plane included)
+static inline uint32_t viewportOutcode(const glm::vec4& p) {
+    return (p.w < EPSILON ? 1u : 0u) | (p.x < -p.w ? 2u : 0u) | (p.x > p.w ? 4u : 0u)
+         | (p.y < -p.w ? 8u : 0u) | (p.y > p.w ? 16u : 0u);
+}
+
+static inline const glm::vec4& clipPosition(const VertexShaderOutput& v) { return v.clipPos; }
+static inline const glm::vec4& clipPosition(const glm::vec4& v) { return v; }
+static inline glm::vec4 interpolate(const glm::vec4& a, const glm::vec4& b, float alpha) { return glm::mix(a, b, alpha); }
+
+// Sutherland-Hodgman against the near plane and the guard band, on stack arrays.
+// Returns the number of polygon vertices written to out (0 or 3..MAX_CLIP_VERTICES).
+template <typename ClipVertex>
+static int clipPolygon(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, uint32_t clipMask,
+    ClipVertex (&out)[Renderer::MAX_CLIP_VERTICES])
+{
+    ClipVertex scratch[Renderer::MAX_CLIP_VERTICES];
+    ClipVertex* src = out;
+    ClipVertex* dst = scratch;
+    src[0] = v0; src[1] = v1; src[2] = v2;
+    int count = 3;
+
+    for (int plane = 0; plane < Renderer::CLIP_PLANE_COUNT && count > 0; ++plane) {
+        if (!(clipMask & (1u << plane))) continue; // 没有顶点在这个平面外
+
+        int outCount = 0;
+        float dPrev = clipDistance(clipPosition(src[count - 1]), plane);
+        for (int i = 0; i < count; ++i) {
+            const ClipVertex& prev = src[(i + count - 1) % count];
+            const ClipVertex& curr = src[i];
+            float dCurr = clipDistance(clipPosition(curr), plane);
+            if ((dPrev >= 0.0f) != (dCurr >= 0.0f)) {
+                dst[outCount++] = interpolate(prev, curr, dPrev / (dPrev - dCurr));
+            }
+            if (dCurr >= 0.0f) {
+                dst[outCount++] = curr;
+            }
+            dPrev = dCurr;
         }
+        std::swap(src, dst);
+        count = outCount;
     }
 
-    if (inside_points.size() == 3) {
-        clipped_tris.push_back({ v0, v1, v2 });
+    if (src != out) {
+        std::copy_n(src, count, out);
     }
-    else if (inside_points.size() == 1 && outside_points.size() == 2) {
-        const VertexShaderOutput& in_v = inside_points[0];
-        const VertexShaderOutput& out_v0 = outside_points[0];
-        const VertexShaderOutput& out_v1 = outside_points[1];
+    return count < 3 ? 0 : count;
+}
 
-        float t0 = (EPSILON - in_v.clipPos.w) / (out_v0.clipPos.w - in_v.clipPos.w);
-        float t1 = (EPSILON - in_v.clipPos.w) / (out_v1.clipPos.w - in_v.clipPos.w);
+int Renderer::clipTriangle(const VertexShaderOutput& v0, const VertexShaderOutput& v1, const VertexShaderOutput& v2,
+    uint32_t clipMask, VertexShaderOutput (&out)[MAX_CLIP_VERTICES]) {
+    return clipPolygon(v0, v1, v2, clipMask, out);
+}
 
-        VertexShaderOutput new_v0 = interpolate(in_v, out_v0, t0);
-        VertexShaderOutput new_v1 = interpolate(in_v, out_v1, t1);
+int Renderer::clipTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2,
+    uint32_t clipMask, glm::vec4 (&out)[MAX_CLIP_VERTICES]) {
+    return clipPolygon(c0, c1, c2, clipMask, out);
+}
 
-        clipped_tris.push_back({ in_v, new_v0, new_v1 });
-    }
-    else if (inside_points.size() == 2 && outside_points.size() == 1) {
-        const VertexShaderOutput& in_v0 = inside_points[0];
-        const VertexShaderOutput& in_v1 = inside_points[1];
-        const VertexShaderOutput& out_v = outside_points[0];
+// Face orientation from the homogeneous determinant |x y w| of the clip-space
+// vertices: positive for counter-clockwise in NDC. Unlike the screen-space area it
+// is valid before clipping, even for vertices behind the eye.
+static inline bool isCulled(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2, Material::CullMode cullMode) {
+    if (cullMode == Material::CullMode::None) return false;
+    float det = c0.x * (c1.y * c2.w - c2.y * c1.w)
+              - c1.x * (c0.y * c2.w - c2.y * c0.w)
+              + c2.x * (c0.y * c1.w - c1.y * c0.w);
+    if (det == 0.0f) return true; // 侧对视点，不覆盖任何像素
+    bool frontFacing = det > 0.0f;
+    return cullMode == Material::CullMode::Back ? !frontFacing : frontFacing;
+}
 
-        float t0 = (EPSILON - in_v0.clipPos.w) / (out_v.clipPos.w - in_v0.clipPos.w);
-        float t1 = (EPSILON - in_v1.clipPos.w) / (out_v.clipPos.w - in_v1.clipPos.w);
+// Number of raster triangles an input triangle produces after culling and clipping
+int Renderer::_clippedTriangleCount(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2, Material::CullMode cullMode) {
+    if (isCulled(c0, c1, c2, cullMode)) {
+        return 0; // 背面/正面剔除，在裁剪和任何像素处理之前
+    }
+    if (viewportOutcode(c0) & viewportOutcode(c1) & viewportOutcode(c2)) {
+        return 0; // 三个顶点都在同一视锥平面外
+    }
+    uint32_t clipMask = guardBandOutcode(c0) | guardBandOutcode(c1) | guardBandOutcode(c2);
+    if (clipMask == 0) {
+        return 1; // trivial accept: 完全在 guard band 内，无需裁剪
+    }
+    // 输出三角形数量只取决于位置
+    glm::vec4 polygon[MAX_CLIP_VERTICES];
+    int count = clipTriangle(c0, c1, c2, clipMask, polygon);
+    return count == 0 ? 0 : count - 2;
+}
 
-        VertexShaderOutput new_v0 = interpolate(in_v0, out_v, t0);
-        VertexShaderOutput new_v1 = interpolate(in_v1, out_v, t1);
+// Per-cluster frustum and normal-cone culling in the object's local space. Returns
+// false when every cluster survives (the mesh is drawn as is); otherwise the
+// survivors are compacted into clusterIndices / clusterVertices.
+bool Renderer::_cullClusters(const Mesh& mesh, const DrawItem& item, Material::CullMode cullMode) {
+    const std::vector<MeshCluster>& clusters = mesh.getLodClusters(item.lod);
+    if (clusters.size() <= 1) return false;
+
+    // 法线锥测试只在相似变换下成立（非均匀缩放会改变角度）
+    const Object& object = *item.object;
+    const glm::mat4& model = object.getMatrix();
+    float sx = glm::length(glm::vec3(model[0])), sy = glm::length(glm::vec3(model[1])), sz = glm::length(glm::vec3(model[2]));
+    const bool coneTest = cullMode != Material::CullMode::None
+        && std::max({ sx, sy, sz }) <= 1.001f * std::min({ sx, sy, sz });
+    const float facing = cullMode == Material::CullMode::Front ? -1.0f : 1.0f; // 剔除背向（Back）或朝向（Front）视点的簇
+    glm::vec4 eye = object.getInverseMatrix() * drawEye;
+    if (eye.w == 0.0f) eye = glm::vec4(glm::normalize(glm::vec3(eye)), 0.0f);
+
+    const Frustum frustum(item.mvp);
+    bool culled = false;
+    clusterVisible.resize(clusters.size());
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        const MeshCluster& cluster = clusters[c];
+        bool visible = frustum.intersects(cluster.bounds);
+        if (visible && coneTest && cluster.coneCutoff < 1.0f) {
+            const glm::vec3 axis = cluster.coneAxis * facing;
+            if (eye.w == 0.0f) {
+                visible = glm::dot(glm::vec3(eye), axis) < cluster.coneCutoff;
+            } else {
+                // 整个包围球内所有点的视线与锥内所有法线夹角都小于 90 度时簇完全背向
+                glm::vec3 toCluster = cluster.center - glm::vec3(eye);
+                visible = glm::dot(toCluster, axis) < cluster.coneCutoff * glm::length(toCluster) + cluster.radius;
+            }
+        }
+        clusterVisible[c] = visible;
+        culled |= !visible;
+    }
+    if (!culled) return false; // 全部可见：直接用原网格，不做任何拷贝
+
+    // 压缩剩余的簇；remap 用完后只复位用到的项，保持全为 UINT32_MAX
+    const std::vector<unsigned int>& levelIndices = mesh.getLodIndices(item.lod);
+    if (clusterVertexRemap.size() < mesh.vertices.size()) clusterVertexRemap.resize(mesh.vertices.size(), UINT32_MAX);
+    clusterIndices.clear();
+    clusterVertices.clear();
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        if (!clusterVisible[c]) continue;
+        const MeshCluster& cluster = clusters[c];
+        for (uint32_t i = cluster.firstIndex; i < cluster.firstIndex + cluster.indexCount; ++i) {
+            uint32_t& slot = clusterVertexRemap[levelIndices[i]];
+            if (slot == UINT32_MAX) {
+                slot = static_cast<uint32_t>(clusterVertices.size());
+                clusterVertices.push_back(mesh.vertices[levelIndices[i]]);
+            }
+            clusterIndices.push_back(slot);
+        }
+    }
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        if (!clusterVisible[c]) continue;
+        const MeshCluster& cluster = clusters[c];
+        for (uint32_t i = cluster.firstIndex; i < cluster.firstIndex + cluster.indexCount; ++i) {
+            clusterVertexRemap[levelIndices[i]] = UINT32_MAX;
+        }
+    }
+    return true;
+}
 
-        clipped_tris.push_back({ in_v0, in_v1, new_v0 });
-        clipped_tris.push_back({ in_v1, new_v1, new_v0 });
+// 按包围球在屏幕上的直径选择 LOD：直径每减半，三角形数量减半
+int Renderer::_selectLod(const Mesh& mesh, const glm::mat4& modelMatrix, const glm::mat4& viewProjectionMatrix,
+    int targetHeight) const {
+    if (mesh.getLodCount() == 1) return 0;
+
+    glm::vec3 center = glm::vec3(modelMatrix * glm::vec4((mesh.bounds.minBounds + mesh.bounds.maxBounds) * 0.5f, 1.0f));
+    float scale = std::max({ glm::length(glm::vec3(modelMatrix[0])), glm::length(glm::vec3(modelMatrix[1])),
+        glm::length(glm::vec3(modelMatrix[2])) });
+    float radius = 0.5f * glm::length(mesh.bounds.maxBounds - mesh.bounds.minBounds) * scale;
+
+    // 投影矩阵第二行的长度即 y 方向的缩放（透视时除以 w）
+    float scaleY = glm::length(glm::vec3(viewProjectionMatrix[0][1], viewProjectionMatrix[1][1], viewProjectionMatrix[2][1]));
+    float diameterPixels = radius * scaleY * static_cast<float>(targetHeight);
+    // w 行为 (0, 0, 0, 1) 即正交投影（proj[3][3] == 1）：屏幕尺寸与距离无关
+    const bool orthographic = viewProjectionMatrix[0][3] == 0.0f && viewProjectionMatrix[1][3] == 0.0f
+        && viewProjectionMatrix[2][3] == 0.0f && viewProjectionMatrix[3][3] == 1.0f;
+    if (!orthographic) {
+        float w = (viewProjectionMatrix * glm::vec4(center, 1.0f)).w;
+        if (w <= radius) return 0; // 相机在包围球内或紧贴包围球
+        diameterPixels /= w;
     }
+    if (diameterPixels >= lodFullDetailPixels) return 0;
+
+    int lod = static_cast<int>(std::log2(lodFullDetailPixels / std::max(diameterPixels, 1.0f)));
+    return std::min(lod, mesh.getLodCount() - 1);
 }
 
-void Renderer::render(Scene scene) {
-    clearBuffers();
-    
-    // 首先渲染shadow map（只为第一个光源，可以扩展为多个）
-    if (!scene.lights.empty()) {
-        renderShadowMap(scene, scene.lights[0]);
+// 视锥剔除：整个物体在视锥外时跳过，不做任何 vertex shading
+void Renderer::_buildDrawList(const Scene& scene, const glm::mat4& viewProjectionMatrix, int targetHeight, bool shadowPass) {
+    // 裁剪空间中 x = y = w = 0 的点即视点；正交投影时它在无穷远，w = 0 表示视线方向
+    drawEye = glm::inverse(viewProjectionMatrix) * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+    if (std::abs(drawEye.w) > EPSILON) {
+        drawEye = glm::vec4(glm::vec3(drawEye) / drawEye.w, 1.0f);
+    } else {
+        drawEye = glm::vec4(glm::normalize(glm::vec3(drawEye)), 0.0f);
     }
-    
-    scene.camera.setAspect(static_cast<float>(screenWidth) / screenHeight);
-    glm::mat4 projectionMatrix = scene.camera.getProjectionMatrix();
-    glm::mat4 viewMatrix = scene.camera.getViewMatrix();
-    glm::mat4 viewProjectionMatrix = projectionMatrix * viewMatrix;
+
+    drawList.clear();
     for (const auto& objectPtr : scene.objects) {
-        Object& object = *objectPtr;
-        glm::mat4 modelMatrix = object.getMatrix();
-        glm::mat4 normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelMatrix)));
-        glm::mat4 mvp = viewProjectionMatrix * modelMatrix;
+        const Mesh& mesh = objectPtr->getMesh();
+        glm::mat4 mvp = viewProjectionMatrix * objectPtr->getMatrix();
+        if (mesh.indices.empty() || !Frustum(mvp).intersects(mesh.bounds)) continue;
+        int lod = _selectLod(mesh, objectPtr->getMatrix(), viewProjectionMatrix, targetHeight);
+        if (shadowPass) lod = std::min(lod + shadowLodBias, mesh.getLodCount() - 1);
+        drawList.push_back({ objectPtr.get(), mvp, lod });
+    }
+}
+
+static inline VertexShaderOutput fetchVertex(const VertexShaderOutputSoA& cache, size_t i, const VertexShaderOutput*) { return cache.get(i); }
+static inline glm::vec4 fetchVertex(const VertexShaderOutputSoA& cache, size_t i, const glm::vec4*) { return cache.getClipPos(i); }
+
+// Culling, guard-band clipping and triangle setup of one object from vertexCache.
+// ClipVertex is VertexShaderOutput for shaded passes and glm::vec4 (clip position
+// only) for depth-only passes, whose triangles carry no vertex attributes.
+template <typename ClipVertex>
+void Renderer::_assembleTriangles(const std::vector<unsigned int>& indices, MaterialId materialId, Material::CullMode cullMode,
+    int targetWidth, int targetHeight) {
+    constexpr bool withAttributes = std::is_same_v<ClipVertex, VertexShaderOutput>;
+    const int triangleCount = static_cast<int>(indices.size() / 3);
+
+    // 1. 每个三角形裁剪后产生的三角形数量
+    clipOffsets.resize(static_cast<size_t>(triangleCount) + 1);
+    #pragma omp parallel for schedule(static)
+    for (int t = 0; t < triangleCount; ++t) {
+        size_t i = static_cast<size_t>(t) * 3;
+        clipOffsets[t + 1] = _clippedTriangleCount(vertexCache.getClipPos(indices[i]), vertexCache.getClipPos(indices[i+1]), vertexCache.getClipPos(indices[i+2]), cullMode);
+    }
+
+    // 2. 前缀和得到输出位置
+    const size_t firstSlot = rasterTriangles.size();
+    clipOffsets[0] = 0;
+    for (int t = 0; t < triangleCount; ++t) {
+        clipOffsets[t + 1] += clipOffsets[t];
+    }
+    rasterTriangles.resize(firstSlot + clipOffsets[triangleCount]);
+
+    // 3. 裁剪并写出三角形
+    #pragma omp parallel for schedule(static)
+    for (int t = 0; t < triangleCount; ++t) {
+        const uint32_t outCount = clipOffsets[t + 1] - clipOffsets[t];
+        if (outCount == 0) continue;
+
+        size_t i = static_cast<size_t>(t) * 3;
+        ClipVertex polygon[MAX_CLIP_VERTICES];
+        polygon[0] = fetchVertex(vertexCache, indices[i], polygon);
+        polygon[1] = fetchVertex(vertexCache, indices[i+1], polygon);
+        polygon[2] = fetchVertex(vertexCache, indices[i+2], polygon);
+        uint32_t clipMask = guardBandOutcode(clipPosition(polygon[0])) | guardBandOutcode(clipPosition(polygon[1])) | guardBandOutcode(clipPosition(polygon[2]));
+        if (clipMask != 0) {
+            clipTriangle(polygon[0], polygon[1], polygon[2], clipMask, polygon);
+        }
+
+        // 多边形按扇形拆分为三角形
+        RasterTriangle* slots = &rasterTriangles[firstSlot + clipOffsets[t]];
+        for (uint32_t k = 0; k < outCount; ++k) {
+            RasterTriangle& tri = slots[k];
+            const ClipVertex* fan[3] = { &polygon[0], &polygon[k + 1], &polygon[k + 2] };
+            for (int j = 0; j < 3; ++j) {
+                // Perspective divide and viewport transform
+                if constexpr (withAttributes) tri.v[j] = *fan[j];
+                const glm::vec4& clipPos = clipPosition(*fan[j]);
+                tri.s[j] = ndcToViewport(glm::vec3(clipPos) / clipPos.w, targetWidth, targetHeight);
+            }
+
+            tri.materialId = INVALID_MATERIAL;
+            float area = glm::cross(tri.s[1] - tri.s[0], tri.s[2] - tri.s[0]).z;
+            if (fabs(area) < EPSILON) continue; // 退化三角形
+            // 保证逆时针方向，防止 area 负值带来插值错误
+            if (area < 0.0f) {
+                if constexpr (withAttributes) std::swap(tri.v[1], tri.v[2]);
+                std::swap(tri.s[1], tri.s[2]);
+                area = -area;
+            }
+            tri.area = area;
+
+            // 不覆盖任何像素中心的三角形直接丢弃；最多 2x2 个候选像素的走快速路径
+            const SampleBounds samples = sampleBounds(tri);
+            if (samples.empty()) continue;
+            tri.micro = samples.width() <= 2 && samples.height() <= 2;
+            tri.materialId = materialId;
+        }
+    }
+}
+
+// Geometry stage: frustum culling per object, vertex shading into the post-transform
+// cache, then guard-band clipping and triangle setup, run in parallel. Output slots
+// are assigned from a prefix sum over per-triangle clip counts, so the result keeps
+// submission order regardless of thread count.
+void Renderer::_setupTriangles(const Scene& scene, int targetWidth, int targetHeight, bool shadowPass) {
+    for (const DrawItem& item : drawList) {
+        Object& object = *item.object;
+        const glm::mat4& mvp = item.mvp;
+        const MaterialId materialId = object.getMaterialId();
+        const Material& material = scene.getMaterial(materialId);
+        const Material::CullMode cullMode = shadowPass ? material.shadowCullMode : material.cullMode;
 
         const Mesh& mesh = object.getMesh();
-        const std::vector<Vertex>& vertices = mesh.vertices;
-        const std::vector<unsigned int>& indices = mesh.indices;
+        const std::vector<Vertex>* shadedVertices = &mesh.vertices;
+        const std::vector<unsigned int>* shadedIndices = &mesh.getLodIndices(item.lod);
+        if (_cullClusters(mesh, item, cullMode)) {
+            // 部分簇被剔除：只对剩余簇引用的顶点做 vertex shading
+            if (clusterIndices.empty()) continue;
+            shadedVertices = &clusterVertices;
+            shadedIndices = &clusterIndices;
+        }
+        const std::vector<Vertex>& vertices = *shadedVertices;
+        const std::vector<unsigned int>& indices = *shadedIndices;
+
+        // 每个顶点只做一次 vertex shading，三角形装配从缓存中取。
+        // 阴影 pass 只写深度，只变换位置，裁剪和装配也不带属性
+        if (shadowPass) {
+            positionShaderBatch(vertices, mvp, vertexCache);
+            _assembleTriangles<glm::vec4>(indices, materialId, cullMode, targetWidth, targetHeight);
+        } else {
+            const glm::mat4 modelMatrix = object.getMatrix();
+            const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelMatrix)));
+            vertexShaderBatch(vertices, modelMatrix, normalMatrix, mvp, vertexCache);
+            _assembleTriangles<VertexShaderOutput>(indices, materialId, cullMode, targetWidth, targetHeight);
+        }
+    }
+}
 
-        #pragma omp parallel for
-        for (size_t i = 0; i < indices.size(); i += 3) {
-            VertexShaderOutput v0 = vertexShader(vertices[indices[i]], modelMatrix, normalMatrix, mvp);
-            VertexShaderOutput v1 = vertexShader(vertices[indices[i+1]], modelMatrix, normalMatrix, mvp);
-            VertexShaderOutput v2 = vertexShader(vertices[indices[i+2]], modelMatrix, normalMatrix, mvp);
+// Binning stage: append every set-up triangle from firstTriangle on to the bins of
+// the tiles its screen bounding box touches.
+void Renderer::_binTriangles(int targetWidth, int targetHeight, uint32_t firstTriangle) {
+    _resetBins(targetWidth, targetHeight);
+    _binTriangleRange(firstTriangle, static_cast<uint32_t>(rasterTriangles.size()), 0, 0, targetWidth, targetHeight);
+}
 
-            // 剪裁（保留完整结构体）
-            std::vector<std::array<VertexShaderOutput, 3>> clippedTriangles;
-            clip_triangle_against_near_plane(v0, v1, v2, clippedTriangles);
+void Renderer::_resetBins(int targetWidth, int targetHeight) {
+    binWidth = targetWidth;
+    binHeight = targetHeight;
+    tilesX = (targetWidth + TILE_SIZE - 1) / TILE_SIZE;
+    tilesY = (targetHeight + TILE_SIZE - 1) / TILE_SIZE;
+    tileBins.resize(static_cast<size_t>(tilesX) * tilesY);
+    for (auto& bin : tileBins) {
+        bin.clear();
+    }
+}
 
-            for (const auto& tri : clippedTriangles) {
-                // Perspective divide and viewport transform
-                glm::vec3 s0 = ndcToScreen(tri[0].clipPos / tri[0].clipPos.w);
-                glm::vec3 s1 = ndcToScreen(tri[1].clipPos / tri[1].clipPos.w);
-                glm::vec3 s2 = ndcToScreen(tri[2].clipPos / tri[2].clipPos.w);
+// Bins triangles [first, end) into the tiles of the pixel rectangle [x0, x1) x [y0, y1).
+// Several views can share one target this way as long as their rectangles are
+// tile aligned: a triangle never reaches tiles outside its own view.
+void Renderer::_binTriangleRange(uint32_t first, uint32_t end, int x0, int y0, int x1, int y1) {
+    for (uint32_t triIdx = first; triIdx < end; ++triIdx) {
+        const RasterTriangle& tri = rasterTriangles[triIdx];
+        if (tri.materialId == INVALID_MATERIAL) continue;
+
+        int minX = std::max(x0, (int)std::floor(std::min({ tri.s[0].x, tri.s[1].x, tri.s[2].x })));
+        int maxX = std::min(x1 - 1, (int)std::ceil(std::max({ tri.s[0].x, tri.s[1].x, tri.s[2].x })));
+        int minY = std::max(y0, (int)std::floor(std::min({ tri.s[0].y, tri.s[1].y, tri.s[2].y })));
+        int maxY = std::min(y1 - 1, (int)std::ceil(std::max({ tri.s[0].y, tri.s[1].y, tri.s[2].y })));
+        if (minX > maxX || minY > maxY) continue; // 完全在屏幕外
+
+        for (int ty = minY / TILE_SIZE; ty <= maxY / TILE_SIZE; ++ty) {
+            for (int tx = minX / TILE_SIZE; tx <= maxX / TILE_SIZE; ++tx) {
+                tileBins[ty * tilesX + tx].push_back(triIdx);
+            }
+        }
+    }
+}
+
+// Light culling: a light with a finite range is projected to the screen through the
+// corners of its bounding box and appended to every tile the rectangle overlaps;
+// lights without a range, or whose box crosses the near plane, go to all tiles.
+// Lists keep scene order, so shading sums lights exactly as before.
+void Renderer::_cullLights(const std::vector<std::shared_ptr< Light >>& lights, const glm::mat4& viewProjectionMatrix) {
+    lightTilesX = (screenWidth + TILE_SIZE - 1) / TILE_SIZE;
+    lightTilesY = (screenHeight + TILE_SIZE - 1) / TILE_SIZE;
+    tileLights.resize(static_cast<size_t>(lightTilesX) * lightTilesY);
+    for (auto& list : tileLights) {
+        list.clear();
+    }
 
-                _drawTrianglePhong(tri[0], tri[1], tri[2], s0, s1, s2, scene.lights, scene.camera, object.getMaterial());
+    const Frustum frustum(viewProjectionMatrix);
+    for (uint32_t lightIdx = 0; lightIdx < lights.size(); ++lightIdx) {
+        const Light& light = *lights[lightIdx];
+        int minTX = 0, maxTX = lightTilesX - 1;
+        int minTY = 0, maxTY = lightTilesY - 1;
+
+        const float range = light.getRange();
+        if (std::isfinite(range)) {
+            const AABB bounds(light.getPosition() - glm::vec3(range), light.getPosition() + glm::vec3(range));
+            if (!frustum.intersects(bounds)) continue; // 光源影响范围完全在视锥外
+
+            float minX = std::numeric_limits<float>::max(), maxX = std::numeric_limits<float>::lowest();
+            float minY = minX, maxY = maxX;
+            bool crossesNear = false;
+            for (int corner = 0; corner < 8 && !crossesNear; ++corner) {
+                glm::vec3 p((corner & 1) ? bounds.maxBounds.x : bounds.minBounds.x,
+                            (corner & 2) ? bounds.maxBounds.y : bounds.minBounds.y,
+                            (corner & 4) ? bounds.maxBounds.z : bounds.minBounds.z);
+                glm::vec4 clip = viewProjectionMatrix * glm::vec4(p, 1.0f);
+                if (clip.w < EPSILON) {
+                    crossesNear = true;
+                    break;
+                }
+                glm::vec3 screen = ndcToViewport(glm::vec3(clip) / clip.w, screenWidth, screenHeight);
+                minX = std::min(minX, screen.x); maxX = std::max(maxX, screen.x);
+                minY = std::min(minY, screen.y); maxY = std::max(maxY, screen.y);
+            }
+            if (!crossesNear) {
+                if (maxX < 0.0f || maxY < 0.0f || minX >= screenWidth || minY >= screenHeight) continue;
+                // w 接近 0 的角点投影后可能超出 int 范围，先在浮点里夹到屏幕内再转换
+                const float lastX = static_cast<float>(screenWidth - 1), lastY = static_cast<float>(screenHeight - 1);
+                minTX = static_cast<int>(std::clamp(minX, 0.0f, lastX)) / TILE_SIZE;
+                maxTX = static_cast<int>(std::clamp(maxX, 0.0f, lastX)) / TILE_SIZE;
+                minTY = static_cast<int>(std::clamp(minY, 0.0f, lastY)) / TILE_SIZE;
+                maxTY = static_cast<int>(std::clamp(maxY, 0.0f, lastY)) / TILE_SIZE;
+            }
+        }
+
+        for (int ty = minTY; ty <= maxTY; ++ty) {
+            for (int tx = minTX; tx <= maxTX; ++tx) {
+                tileLights[ty * lightTilesX + tx].push_back(lightIdx);
             }
         }
     }
-    // gamma correction
-    for (int i = 0; i < framebuffer.width * framebuffer.height; ++i) {
-        uint32_t color = framebuffer[i];
-        glm::vec3 linearColor = Color::Uint32ToVec(color);
-        linearColor.r = glm::pow(linearColor.r, 1.0f / 2.2f);
-        linearColor.g = glm::pow(linearColor.g, 1.0f / 2.2f);
-        linearColor.b = glm::pow(linearColor.b, 1.0f / 2.2f);
-        framebuffer[i] = Color::VecToUint32(linearColor);
+}
+
+// Raster stage: each worker takes whole tiles, draws the tile's bin in submission
+// order into tile-local storage, then writes the tile back. Tiles never overlap,
+// so the result is race-free and identical to a serial run.
+template <typename DrawFn>
+void Renderer::_rasterizeTiles(Buffer<float>& depthTarget, Buffer<uint32_t>* colorTarget, DrawFn drawTriangle,
+    int originX, int originY) {
+    const int tileCount = tilesX * tilesY;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int t = 0; t < tileCount; ++t) {
+        const std::vector<uint32_t>& bin = tileBins[t];
+        if (bin.empty()) continue;
+
+        RasterTile tile;
+        tile.x0 = (t % tilesX) * TILE_SIZE;
+        tile.y0 = (t / tilesX) * TILE_SIZE;
+        tile.x1 = std::min(tile.x0 + TILE_SIZE, binWidth);
+        tile.y1 = std::min(tile.y0 + TILE_SIZE, binHeight);
+        const int rowLength = tile.x1 - tile.x0;
+        if (rowLength < TILE_SIZE || tile.y1 - tile.y0 < TILE_SIZE) {
+            // storage past the target edge is never covered; zero depth keeps it out of block rejection
+            std::fill(std::begin(tile.depth), std::end(tile.depth), 0.0f);
+        }
+
+        for (int y = tile.y0; y < tile.y1; ++y) {
+            std::copy_n(&depthTarget(originX + tile.x0, originY + y), rowLength, &tile.depth[(y - tile.y0) * TILE_SIZE]);
+            if (colorTarget) {
+                std::copy_n(&(*colorTarget)(originX + tile.x0, originY + y), rowLength, &tile.color[(y - tile.y0) * TILE_SIZE]);
+            }
+        }
+
+        tile.buildHiZ();
+
+        for (uint32_t triIdx : bin) {
+            drawTriangle(rasterTriangles[triIdx], triIdx, tile);
+        }
+
+        for (int y = tile.y0; y < tile.y1; ++y) {
+            std::copy_n(&tile.depth[(y - tile.y0) * TILE_SIZE], rowLength, &depthTarget(originX + tile.x0, originY + y));
+            if (colorTarget) {
+                std::copy_n(&tile.color[(y - tile.y0) * TILE_SIZE], rowLength, &(*colorTarget)(originX + tile.x0, originY + y));
+            }
+        }
     }
 }
 
-void Renderer::renderRayTracing(Scene scene) {
+// Scene geometry seen from the frame camera, into zbuffer (+ colorTarget).
+// Objects behind the reprojected depth of the previous frame are held back; after
+// the rest is drawn they are tested again against this frame's depth, and the ones
+// that turn out visible are set up and drawn on top.
+template <typename DrawFn>
+void Renderer::_drawCameraPass(const Scene& scene, Buffer<uint32_t>* colorTarget, DrawFn drawTriangle) {
+    const glm::mat4& viewProjectionMatrix = frameCamera.viewProjectionMatrix;
+    _buildDrawList(scene, viewProjectionMatrix, screenHeight);
+
+    occludedDraws.clear();
+    if (occlusionCulling && occlusionCuller.reproject(viewProjectionMatrix, screenWidth, screenHeight)) {
+        auto hidden = std::stable_partition(drawList.begin(), drawList.end(), [this](const DrawItem& item) {
+            return occlusionCuller.isVisible(item.object->getMesh().bounds, item.mvp);
+        });
+        occludedDraws.assign(hidden, drawList.end());
+        drawList.erase(hidden, drawList.end());
+    }
+
+    rasterTriangles.clear();
+    _setupTriangles(scene, screenWidth, screenHeight);
+    _binTriangles(screenWidth, screenHeight);
+    _rasterizeTiles(zbuffer, colorTarget, drawTriangle);
+
+    if (!occlusionCulling) {
+        occlusionCuller.invalidate();
+        return;
+    }
+
+    // 第二遍：用本帧已有的深度重新测试，补画重投影漏掉的物体
+    occlusionCuller.update(zbuffer, viewProjectionMatrix);
+    drawList.clear();
+    for (const DrawItem& item : occludedDraws) {
+        if (occlusionCuller.isVisible(item.object->getMesh().bounds, item.mvp)) {
+            drawList.push_back(item);
+        }
+    }
+    if (drawList.empty()) return;
+
+    const uint32_t firstTriangle = static_cast<uint32_t>(rasterTriangles.size());
+    _setupTriangles(scene, screenWidth, screenHeight);
+    _binTriangles(screenWidth, screenHeight, firstTriangle);
+    _rasterizeTiles(zbuffer, colorTarget, drawTriangle);
+    occlusionCuller.update(zbuffer, viewProjectionMatrix); // history for the next frame
+}
+
+// Snapshots the camera for this frame: only the camera is copied, never the scene
+void Renderer::_beginFrame(const Camera& camera) {
+    frameCamera.camera = camera;
+    frameCamera.camera.setAspect(static_cast<float>(screenWidth) / screenHeight);
+    frameCamera.position = frameCamera.camera.getPosition();
+    frameCamera.viewMatrix = frameCamera.camera.getViewMatrix();
+    frameCamera.inverseViewMatrix = glm::inverse(frameCamera.viewMatrix);
+    frameCamera.projectionMatrix = frameCamera.camera.getProjectionMatrix();
+    frameCamera.viewProjectionMatrix = frameCamera.projectionMatrix * frameCamera.viewMatrix;
+}
+
+void Renderer::render(const Scene& scene) {
     clearBuffers();
+    _beginFrame(scene.camera);
+    
+    // 首先渲染所有光源的 shadow map（图集中未变化的区域直接复用）
+    renderShadowMaps(scene);
+
+    _drawCameraPass(scene, &visibilityBuffer, [this](const RasterTriangle&, uint32_t triIdx, RasterTile& tile) {
+        _drawTriangleVisibility(triIdx, tile);
+    });
+    _cullLights(scene.lights, frameCamera.viewProjectionMatrix);
+    _resolvePhong(scene);
+
+    // tone mapping + sRGB encode
+    ToneMapper::resolve(hdrBuffer, framebuffer, toneMapping, exposure);
+}
+
+void Renderer::renderRayTracing(const Scene& scene) {
+    clearBuffers();
+    _beginFrame(scene.camera);
     // save mode only!
     // if (firstFrameSaved){
     //     exit(0);
@@ -321,7 +838,7 @@ void Renderer::renderRayTracing(Scene scene) {
                 float sample_y = static_cast<float>(y) + rand_v;
 
                 // 使用随机化的坐标生成光线
-                Ray ray = scene.camera.generateRay(sample_x, sample_y, screenWidth, screenHeight);
+                Ray ray = frameCamera.camera.generateRay(sample_x, sample_y, screenWidth, screenHeight);
 
                 // 追踪光线并累加颜色
                 accumulatedColor += traceRay(ray, scene, 0);
@@ -329,18 +846,16 @@ void Renderer::renderRayTracing(Scene scene) {
 
             // --- 计算平均颜色 ---
             glm::vec3 finalColor = accumulatedColor / static_cast<float>(SAMPLES_PER_PIXEL);
-            
-            // --- Gamma 校正 ---
-            finalColor.r = glm::pow(finalColor.r, 1.0f / 2.2f);
-            finalColor.g = glm::pow(finalColor.g, 1.0f / 2.2f);
-            finalColor.b = glm::pow(finalColor.b, 1.0f / 2.2f);
 
-            // Write the color to the framebuffer
-            framebuffer.setPixel(x, y, Color::VecToUint32(finalColor));
+            // Write the linear color to the HDR target
+            hdrBuffer.setPixel(x, y, finalColor);
         }
     }
     std::fprintf(stderr, "\nDone.\n");
 
+    // tone mapping + sRGB encode
+    ToneMapper::resolve(hdrBuffer, framebuffer, toneMapping, exposure);
+
     // if (!firstFrameSaved) {
     //     // Save the first frame to a file
     //     ResourceManager::saveFramebufferToBMP("ray_tracing_output.bmp", getBuffer());
@@ -357,8 +872,8 @@ glm::vec3 Renderer::traceRay(const Ray& ray, const Scene& scene, int depth) {
     if (!scene.intersect(ray, intersection)) {
         return scene.getBackgroundColor();
     }
-    const Material& mat = *intersection.material;
-    glm::vec3 viewDir = glm::normalize(scene.camera.getPosition() - intersection.position);
+    const Material& mat = scene.getMaterial(intersection.materialId);
+    glm::vec3 viewDir = glm::normalize(frameCamera.position - intersection.position);
 
     // --- 主要修改区域 ---
     // Emissive color (if the object itself is a light source)
@@ -401,12 +916,15 @@ glm::vec3 Renderer::traceRay(const Ray& ray, const Scene& scene, int depth) {
 
         } else {
             // --- 这是点光源 (Point Light) 或其他类型光的处理逻辑 (保持原样) ---
+            // 与光栅化、SSAO 路径一致：按范围窗口衰减，到 getRange() 处为 0，超出范围不必求交
+            const float window = light->rangeWindow(intersection.position);
+            if (window <= 0.0f) continue;
             glm::vec3 lightPos = light->getPosition();
             if (isInShadow(intersection.position, scene, lightPos)) {
                 continue;
             }
             glm::vec3 lightDir = light->getDirection(intersection.position);
-            glm::vec3 lightColor = light->getColor() * light->getIntensity(intersection.position);
+            glm::vec3 lightColor = light->getColor() * (light->getIntensity(intersection.position) * window);
             directLightingColor += mat.computeBRDF(intersection.normal, intersection.uv, viewDir, lightDir, lightColor);
             // directLightingColor += mat.computePhong(intersection.normal, intersection.uv, viewDir, lightDir, lightColor);
         }
@@ -431,7 +949,7 @@ glm::vec3 Renderer::traceRay(const Ray& ray, const Scene& scene, int depth) {
     // === 3. optionally compute refraction ===
     // (你的折射逻辑保持不变, 但请注意混合方式)
     if (mat.transparency > 0.0f) {
-        Ray refractedRay = computeRefractedRay(ray, intersection); // 假设你已实现此函数
+        Ray refractedRay = computeRefractedRay(ray, intersection, mat.ior); // 假设你已实现此函数
         glm::vec3 refractedColor = traceRay(refractedRay, scene, depth + 1);
         // 使用 mix 混合直接光照/反射和折射
         // 注意：这里的混合可能需要更复杂的物理模型，但 mix 是一个不错的开始
@@ -451,10 +969,10 @@ Ray Renderer::computeReflectedRay(const Ray& ray, const Intersection& isect) {
     return Ray(origin, reflectedDir);
 }
 
-Ray Renderer::computeRefractedRay(const Ray& ray, const Intersection& isect) {
+Ray Renderer::computeRefractedRay(const Ray& ray, const Intersection& isect, float ior) {
     glm::vec3 incident = glm::normalize(ray.direction);
     glm::vec3 normal = isect.normal;
-    float eta = isect.material->ior;
+    float eta = ior;
 
     // 判断是否从内部射出
     float cosi = glm::dot(incident, normal);
@@ -527,47 +1045,26 @@ float Renderer::computeSoftShadow(const glm::vec3& point, const Scene& scene, co
     return 1.0f - float(occludedSamples) / numSamples; // 返回未遮挡比例
 }
 
-void Renderer::setupLightMatrices(const std::shared_ptr<Light>& light) {
-    // 获取光源位置
-    glm::vec3 currentLightPos = light->getPosition();
-    
-    // 检查是否需要重新计算矩阵
-    if (lightMatricesValid && glm::distance(currentLightPos, lastLightPosition) < 0.001f) {
-        return; // 光源位置没有显著变化，不需要重新计算
-    }
-    
-    // 获取光源位置和方向
+// View-projection of the single map of a spot light (point lights use a cube)
+glm::mat4 Renderer::_lightViewProjection(const Light& light, ShadowAtlas::Projection& projection) {
     glm::vec3 lightPos;
     glm::vec3 lightDir;
-    
-    if (auto dirLight = std::dynamic_pointer_cast<DirectionalLight>(light)) {
-        // 方向光：设置一个足够远的位置
-        lightDir = glm::normalize(dirLight->direction);
-        lightPos = -lightDir * 20.0f; // 减少距离，更好地覆盖场景
-        
-        // 正交投影适合方向光，调整投影范围以更好地覆盖场景
-        float orthoSize = 5.0f; // 减小投影范围以提高shadow map精度
-        lightProjectionMatrix = glm::ortho(-orthoSize, orthoSize, -orthoSize, orthoSize, 0.1f, 50.0f);
-    } else if (auto pointLight = std::dynamic_pointer_cast<PointLight>(light)) {
-        // 点光源：使用透视投影，朝向场景中心
-        lightPos = pointLight->getPosition();
-        glm::vec3 sceneCenter = glm::vec3(0.0f, 1.0f, 0.0f); // 场景中心点
-        lightDir = glm::normalize(sceneCenter - lightPos); // 从光源指向场景中心
-        
-        // 调整FOV以更好地覆盖场景
-        lightProjectionMatrix = glm::perspective(glm::radians(120.0f), 1.0f, 0.1f, pointLight->range);
-    } else if (auto spotLight = std::dynamic_pointer_cast<SpotLight>(light)) {
+    glm::mat4 lightProjectionMatrix;
+
+    if (auto spotLight = dynamic_cast<const SpotLight*>(&light)) {
         // 聚光灯：使用透视投影
         lightPos = spotLight->getPosition();
         lightDir = spotLight->direction;
         
         float fov = spotLight->outerAngle * 2.0f; // 外角的两倍作为FOV
         lightProjectionMatrix = glm::perspective(glm::radians(fov), 1.0f, 0.1f, spotLight->range);
+        projection = { 0.1f, spotLight->range, true };
     } else {
         // 默认设置
         lightPos = glm::vec3(0.0f, 10.0f, 0.0f);
         lightDir = glm::vec3(0.0f, -1.0f, 0.0f);
         lightProjectionMatrix = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, 0.1f, 50.0f);
+        projection = { 0.1f, 50.0f, false };
     }
     
     // 计算view矩阵
@@ -576,160 +1073,355 @@ void Renderer::setupLightMatrices(const std::shared_ptr<Light>& light) {
         up = glm::vec3(1.0f, 0.0f, 0.0f); // 如果方向和up太接近，换个up向量
     }
     
-    lightViewMatrix = glm::lookAt(lightPos, lightPos + lightDir, up);
-    lightViewProjectionMatrix = lightProjectionMatrix * lightViewMatrix;
-    
-    // 更新状态
-    lastLightPosition = currentLightPos;
-    lightMatricesValid = true;
+    return lightProjectionMatrix * glm::lookAt(lightPos, lightPos + lightDir, up);
 }
 
-void Renderer::renderShadowMap(const Scene& scene, const std::shared_ptr<Light>& light) {
-    // 设置光源矩阵
-    setupLightMatrices(light);
-    
-    // 清空shadow map
-    shadowMap.clear(std::numeric_limits<float>::max());
-    
-    // 从光源视角渲染场景
-    for (const auto& objectPtr : scene.objects) {
-        Object& object = *objectPtr;
-        glm::mat4 modelMatrix = object.getMatrix();
-        glm::mat4 normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelMatrix)));
-        glm::mat4 mvp = lightViewProjectionMatrix * modelMatrix;
+// Fraction of the screen height the light's range sphere spans, 1 when unbounded
+// or when the camera is inside it; 0 when it cannot reach the view at all
+float Renderer::_shadowCoverage(const Light& light) const {
+    const float range = light.getRange();
+    if (!std::isfinite(range)) return 1.0f;
 
-        const Mesh& mesh = object.getMesh();
-        const std::vector<Vertex>& vertices = mesh.vertices;
-        const std::vector<unsigned int>& indices = mesh.indices;
+    const glm::vec3 center = light.getPosition();
+    if (!Frustum(frameCamera.viewProjectionMatrix).intersects(AABB(center - glm::vec3(range), center + glm::vec3(range)))) {
+        return 0.0f;
+    }
+    const float w = (frameCamera.viewProjectionMatrix * glm::vec4(center, 1.0f)).w;
+    if (w <= range) return 1.0f;
+    return std::min(1.0f, range * frameCamera.projectionMatrix[1][1] / w);
+}
+
+// FNV-1a, identifies what a shadow view would render
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Lays out the atlas for all lights of the scene and renders the views whose light
+// or casters changed since they were last drawn
+void Renderer::renderShadowMaps(const Scene& scene) {
+    shadowRequests.clear();
+    std::vector<LightShadow> previousShadows = std::move(lightShadows); // 上一帧的尺寸，用于滞回
+    previousShadows.resize(scene.lights.size());
+    lightShadows.assign(scene.lights.size(), LightShadow{});
+    for (size_t lightIdx = 0; lightIdx < scene.lights.size(); ++lightIdx) {
+        const Light* light = scene.lights[lightIdx].get();
+        LightShadow& shadow = lightShadows[lightIdx];
+        shadow.firstView = static_cast<int>(shadowRequests.size());
+        if (dynamic_cast<const DirectionalLight*>(light)) {
+            shadow.type = LightShadow::Type::Cascades;
+            shadow.viewCount = shadowCascades.count();
+            for (int c = 0; c < shadow.viewCount; ++c) {
+                shadowRequests.push_back({ light, c, shadowCascades.resolution[c] });
+            }
+            continue;
+        }
 
-        for (size_t i = 0; i < indices.size(); i += 3) {
-            VertexShaderOutput v0 = vertexShader(vertices[indices[i]], modelMatrix, normalMatrix, mvp);
-            VertexShaderOutput v1 = vertexShader(vertices[indices[i+1]], modelMatrix, normalMatrix, mvp);
-            VertexShaderOutput v2 = vertexShader(vertices[indices[i+2]], modelMatrix, normalMatrix, mvp);
+        // 按屏幕覆盖率分配：覆盖不到半屏高时每减半，边长减半
+        const float coverage = _shadowCoverage(*light);
+        if (coverage <= 0.0f) continue; // 照不到视锥内，不需要阴影
+        auto sizeFor = [&](float c) {
+            int size = shadowMapSize;
+            while (size > shadowAtlas.minRegionSize && c < 0.5f) {
+                size /= 2;
+                c *= 2.0f;
+            }
+            return size;
+        };
+        // 滞回：覆盖率越过阈值一定幅度才换尺寸，否则相机移动时请求来回变化，整个图集重新布局
+        int size = sizeFor(coverage);
+        if (previousShadows[lightIdx].size > 0) {
+            size = std::clamp(previousShadows[lightIdx].size, sizeFor(coverage / SHADOW_SIZE_HYSTERESIS),
+                sizeFor(coverage * SHADOW_SIZE_HYSTERESIS));
+        }
+        shadow.size = size;
+        if (dynamic_cast<const PointLight*>(light)) {
+            // 点光源：立方体六个面
+            shadow.type = LightShadow::Type::Cube;
+            shadow.viewCount = 6;
+            shadow.lightPosition = light->getPosition();
+            for (int face = 0; face < 6; ++face) {
+                shadowRequests.push_back({ light, face, size });
+            }
+            continue;
+        }
+        shadow.viewCount = 1;
+        shadowRequests.push_back({ light, 0, size });
+    }
+    shadowAtlas.allocate(shadowRequests);
 
-            // 剪裁
-            std::vector<std::array<VertexShaderOutput, 3>> clippedTriangles;
-            clip_triangle_against_near_plane(v0, v1, v2, clippedTriangles);
+    shadowViews.assign(shadowRequests.size(), ShadowView{});
+    for (size_t i = 0; i < shadowViews.size(); ++i) {
+        shadowViews[i].region = shadowAtlas.region(i);
+    }
 
-            for (const auto& tri : clippedTriangles) {
-                // 转换到shadow map的屏幕空间
-                glm::vec3 s0 = ndcToShadowMapScreen(tri[0].clipPos / tri[0].clipPos.w);
-                glm::vec3 s1 = ndcToShadowMapScreen(tri[1].clipPos / tri[1].clipPos.w);
-                glm::vec3 s2 = ndcToShadowMapScreen(tri[2].clipPos / tri[2].clipPos.w);
+    AABB casterBounds;
+    bool casterBoundsValid = false;
+    for (size_t lightIdx = 0; lightIdx < scene.lights.size(); ++lightIdx) {
+        const LightShadow& shadow = lightShadows[lightIdx];
+        if (shadow.viewCount == 0) continue;
+        ShadowView* views = &shadowViews[shadow.firstView];
+
+        if (shadow.type == LightShadow::Type::Cube) {
+            const float farClip = std::max(scene.lights[lightIdx]->getRange(), 2.0f * CUBE_SHADOW_NEAR);
+            for (int face = 0; face < 6; ++face) {
+                views[face].viewProjection = _cubeFaceViewProjection(shadow.lightPosition, face, CUBE_SHADOW_NEAR, farClip);
+                views[face].projection = { CUBE_SHADOW_NEAR, farClip, true };
+            }
+            _renderCubeShadow(scene, shadow.firstView);
+            _prepareShadowMoments(shadow);
+            continue;
+        }
 
-                _drawTriangleDepthOnly(tri[0], tri[1], tri[2], s0, s1, s2);
+        if (shadow.type == LightShadow::Type::Cascades) {
+            // 方向光：按相机视锥切片拟合级联
+            if (!casterBoundsValid) {
+                for (const auto& object : scene.objects) {
+                    if (!object->getMesh().indices.empty()) casterBounds.extend(object->getWorldBounds());
+                }
+                casterBoundsValid = true;
+            }
+            std::array<int, CascadedShadowMap::MAX_CASCADES> sizes{};
+            for (int c = 0; c < shadow.viewCount; ++c) sizes[c] = views[c].region.size;
+            // getDirection() 指向光源（与着色一致），光线沿其反方向传播
+            const Camera& camera = frameCamera.camera;
+            shadowCascades.fit(-scene.lights[lightIdx]->getDirection(glm::vec3(0.0f)), frameCamera.viewProjectionMatrix,
+                camera.getNearClip(), camera.getFarClip(), casterBounds, sizes);
+            for (int c = 0; c < shadow.viewCount; ++c) {
+                views[c].viewProjection = shadowCascades[c].viewProjection;
+                views[c].projection = { shadowCascades[c].nearClip, shadowCascades[c].farClip, false };
+                views[c].splitFar = shadowCascades[c].splitFar;
             }
+        } else {
+            views[0].viewProjection = _lightViewProjection(*scene.lights[lightIdx], views[0].projection);
+        }
+
+        for (int v = 0; v < shadow.viewCount; ++v) {
+            _renderShadowView(scene, shadow.firstView + v);
         }
+        _prepareShadowMoments(shadow);
     }
 }
 
-void Renderer::_drawTriangleDepthOnly(
-    const VertexShaderOutput& v0, const VertexShaderOutput& v1, const VertexShaderOutput& v2,
-    const glm::vec3& s0, const glm::vec3& s1, const glm::vec3& s2) {
-    
-    float area = glm::cross(s1 - s0, s2 - s0).z;
-    if (fabs(area) < EPSILON) {
-        return; // 退化三角形
+// 光源矩阵和视锥内的投射者都没变时，图集里上次的深度仍然有效
+uint64_t Renderer::_shadowSignature(const Scene& scene, const glm::mat4& lightViewProjection) const {
+    uint64_t signature = hashBytes(1469598103934665603ull, &lightViewProjection, sizeof(lightViewProjection));
+    for (const DrawItem& item : drawList) {
+        const Object& object = *item.object;
+        const Mesh* mesh = &object.getMesh();
+        const MaterialId materialId = object.getMaterialId();
+        const Material::CullMode cullMode = scene.getMaterial(materialId).shadowCullMode;
+        signature = hashBytes(signature, &item.object, sizeof(item.object));
+        const glm::mat4 model = object.getMatrix();
+        signature = hashBytes(signature, &model, sizeof(model));
+        signature = hashBytes(signature, &mesh, sizeof(mesh));
+        signature = hashBytes(signature, &item.lod, sizeof(item.lod));
+        signature = hashBytes(signature, &cullMode, sizeof(cullMode));
     }
-    if (area < 0.0f) {
-        _drawTriangleDepthOnly(v0, v2, v1, s0, s2, s1);
-        return;
+    return signature;
+}
+
+void Renderer::_renderShadowView(const Scene& scene, size_t viewIdx) {
+    const ShadowView& view = shadowViews[viewIdx];
+    const int size = view.region.size;
+    if (size == 0) return; // 图集放不下
+
+    _buildDrawList(scene, view.viewProjection, size, true);
+    if (shadowAtlas.isCached(viewIdx, _shadowSignature(scene, view.viewProjection))) return;
+
+    shadowAtlas.clearRegion(view.region);
+    rasterTriangles.clear();
+    _setupTriangles(scene, size, size, true);
+    _binTriangles(size, size);
+    _rasterizeTiles(shadowAtlas.depth, nullptr, [this](const RasterTriangle& tri, uint32_t triIdx, RasterTile& tile) {
+        _drawTriangleDepthOnly(tri, triIdx, tile);
+    }, view.region.x, view.region.y);
+    shadowAtlas.storeLinearDepth(view.region, shadowAtlas.depth, view.region.x, view.region.y, view.projection);
+}
+
+// VSM / EVSM read blurred moments instead of depth; regions that were not
+// rendered this frame keep theirs
+void Renderer::_prepareShadowMoments(const LightShadow& shadow) {
+    if (shadowFilter != ShadowAtlas::Filter::VSM && shadowFilter != ShadowAtlas::Filter::EVSM) return;
+    for (int v = shadow.firstView; v < shadow.firstView + shadow.viewCount; ++v) {
+        shadowAtlas.prepareMoments(v, shadowFilter, shadowViews[v].projection);
     }
+}
 
-    int minX = std::max(0, (int)std::floor(std::min({ s0.x, s1.x, s2.x })));
-    int maxX = std::min(SHADOW_MAP_SIZE - 1, (int)std::ceil(std::max({ s0.x, s1.x, s2.x })));
-    int minY = std::max(0, (int)std::floor(std::min({ s0.y, s1.y, s2.y })));
-    int maxY = std::min(SHADOW_MAP_SIZE - 1, (int)std::ceil(std::max({ s0.y, s1.y, s2.y })));
-
-    for (int y = minY; y <= maxY; ++y) {
-        for (int x = minX; x <= maxX; ++x) {
-            glm::vec3 p(x + 0.5f, y + 0.5f, 0.0f);
-            if (_insideTriangle(p, s0, s1, s2)) {
-                float a = (glm::cross(s1 - p, s2 - p)).z / area;
-                float b = (glm::cross(s2 - p, s0 - p)).z / area;
-                float c = (glm::cross(s0 - p, s1 - p)).z / area;
-
-                float z = a * s0.z + b * s1.z + c * s2.z;
-                int idx = y * SHADOW_MAP_SIZE + x;
-                
-                if (z < shadowMap[idx]) {
-                    shadowMap[idx] = z;
-                }
-            }
+// Face order +X, -X, +Y, -Y, +Z, -Z; each face is a 90 degree frustum
+glm::mat4 Renderer::_cubeFaceViewProjection(const glm::vec3& position, int face, float nearClip, float farClip) {
+    static const glm::vec3 axes[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+    static const glm::vec3 ups[6] = { { 0, 1, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 0, 0, 1 }, { 0, 1, 0 }, { 0, 1, 0 } };
+    return glm::perspective(glm::radians(90.0f), 1.0f, nearClip, farClip)
+        * glm::lookAt(position, position + axes[face], ups[face]);
+}
+
+// The six faces of a cube are set up one after another into a single target, each
+// in its own band of rows, and then rasterized together: the tile loop sees the
+// tiles of all faces at once. Faces whose casters did not change keep their atlas
+// region; the others are converted to linear depth on the way into the atlas.
+void Renderer::_renderCubeShadow(const Scene& scene, size_t firstView) {
+    int band = 0;
+    for (int face = 0; face < 6; ++face) band = std::max(band, shadowViews[firstView + face].region.size);
+    if (band == 0) return;
+    band = (band + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE; // 每个面从整 tile 开始，三角形不会落进别的面
+    if (cubeFaceDepth.width != band || cubeFaceDepth.height != 6 * band) {
+        cubeFaceDepth = Buffer<float>(band, 6 * band);
+    }
+
+    uint32_t faceStart[7];
+    bool dirty[6] = {};
+    rasterTriangles.clear();
+    for (int face = 0; face < 6; ++face) {
+        faceStart[face] = static_cast<uint32_t>(rasterTriangles.size());
+        const ShadowView& view = shadowViews[firstView + face];
+        const int size = view.region.size;
+        if (size == 0) continue;
+
+        // 逐面视锥剔除投射者
+        _buildDrawList(scene, view.viewProjection, size, true);
+        if (shadowAtlas.isCached(firstView + face, _shadowSignature(scene, view.viewProjection))) continue;
+        dirty[face] = true;
+
+        _setupTriangles(scene, size, size, true);
+        const float offsetY = static_cast<float>(face * band);
+        for (size_t i = faceStart[face]; i < rasterTriangles.size(); ++i) {
+            for (glm::vec3& s : rasterTriangles[i].s) s.y += offsetY;
         }
+        for (int y = face * band; y < face * band + size; ++y) {
+            std::fill_n(&cubeFaceDepth(0, y), size, std::numeric_limits<float>::max());
+        }
+    }
+    faceStart[6] = static_cast<uint32_t>(rasterTriangles.size());
+    if (std::none_of(std::begin(dirty), std::end(dirty), [](bool d) { return d; })) return;
+
+    _resetBins(band, 6 * band);
+    for (int face = 0; face < 6; ++face) {
+        if (!dirty[face]) continue;
+        const int size = shadowViews[firstView + face].region.size;
+        _binTriangleRange(faceStart[face], faceStart[face + 1], 0, face * band, size, face * band + size);
+    }
+    _rasterizeTiles(cubeFaceDepth, nullptr, [this](const RasterTriangle& tri, uint32_t triIdx, RasterTile& tile) {
+        _drawTriangleDepthOnly(tri, triIdx, tile);
+    });
+
+    for (int face = 0; face < 6; ++face) {
+        const ShadowView& view = shadowViews[firstView + face];
+        if (dirty[face]) shadowAtlas.storeLinearDepth(view.region, cubeFaceDepth, 0, face * band, view.projection);
     }
 }
 
-glm::vec3 Renderer::ndcToShadowMapScreen(const glm::vec3& ndc) const {
-    float x = (ndc.x + 1.0f) * 0.5f * SHADOW_MAP_SIZE;
-    float y = (1.0f - ndc.y) * 0.5f * SHADOW_MAP_SIZE;
-    float z = (ndc.z + 1.0f) * 0.5f;
-    return glm::vec3(x, y, z);
+void Renderer::_drawTriangleDepthOnly(const RasterTriangle& tri, uint32_t, RasterTile& tile) {
+    // the kernel performs the depth test and write, there is nothing left to shade
+    rasterizeTriangle(tri, tile, [](int, int, int, float, float, float) {});
 }
 
-float Renderer::sampleShadowMap(const glm::vec3& worldPos) const {
-    // 将世界坐标转换到光源空间
-    glm::vec4 lightSpacePos = lightViewProjectionMatrix * glm::vec4(worldPos, 1.0f);
-    
-    // 透视除法
-    glm::vec3 projCoords = glm::vec3(lightSpacePos) / lightSpacePos.w;
-    
-    // 转换到[0,1]范围
-    projCoords = projCoords * 0.5f + 0.5f;
-    
-    // 检查是否在shadow map范围内
-    if (projCoords.x < 0.0f || projCoords.x > 1.0f || 
-        projCoords.y < 0.0f || projCoords.y > 1.0f ||
-        projCoords.z > 1.0f) {
-        return 1.0f; // 在范围外，不在阴影中
+// World size of one shadow map texel at p: the projection's y scale over w
+static float shadowTexelSize(const glm::mat4& viewProjection, int size, const glm::vec3& p) {
+    const float w = viewProjection[0][3] * p.x + viewProjection[1][3] * p.y + viewProjection[2][3] * p.z + viewProjection[3][3];
+    const float scaleY = glm::length(glm::vec3(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1]));
+    return 2.0f * std::max(w, EPSILON) / (size * scaleY);
+}
+
+// 1 = lit, 0 = shadowed by lightIdx. Cascades are picked by the view depth of the point.
+// The lookup point is pushed along the normal by a texel or two (normal offset),
+// which removes acne on surfaces the light grazes without a large depth bias.
+float Renderer::sampleShadow(uint32_t lightIdx, const glm::vec3& worldPos, const glm::vec3& normal) const {
+    if (lightIdx >= lightShadows.size()) return 1.0f;
+    const LightShadow& shadow = lightShadows[lightIdx];
+    if (shadow.viewCount == 0) return 1.0f;
+
+    int v = shadow.firstView;
+    if (shadow.type == LightShadow::Type::Cube) {
+        // 主轴决定面
+        const glm::vec3 d = worldPos - shadow.lightPosition;
+        const glm::vec3 a = glm::abs(d);
+        const int axis = (a.x >= a.y && a.x >= a.z) ? 0 : (a.y >= a.z ? 1 : 2);
+        v += axis * 2 + (d[axis] < 0.0f ? 1 : 0);
+    } else if (shadow.type == LightShadow::Type::Cascades) {
+        const float viewDepth = -(frameCamera.viewMatrix * glm::vec4(worldPos, 1.0f)).z;
+        const int end = shadow.firstView + shadow.viewCount;
+        while (v < end && viewDepth > shadowViews[v].splitFar) ++v;
+        if (v == end) return 1.0f; // 超出阴影距离
     }
-    
-    // 采样shadow map
-    int x = (int)(projCoords.x * (SHADOW_MAP_SIZE - 1));
-    int y = (int)(projCoords.y * (SHADOW_MAP_SIZE - 1));
-    
-    // 边界检查
-    if (x < 0 || x >= SHADOW_MAP_SIZE || y < 0 || y >= SHADOW_MAP_SIZE) {
-        return 1.0f;
+    const ShadowView& view = shadowViews[v];
+    const int size = view.region.size;
+    if (size == 0) return 1.0f;
+
+    const float texel = shadowTexelSize(view.viewProjection, size, worldPos);
+    const glm::vec3 p = worldPos + normal * (SHADOW_NORMAL_OFFSET * texel);
+    const glm::vec4 clip = view.viewProjection * glm::vec4(p, 1.0f);
+    if (clip.w <= EPSILON) return 1.0f; // 在光源后面
+    const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+    if (shadow.type != LightShadow::Type::Cube && (ndc.z > 1.0f || std::abs(ndc.x) > 1.0f || std::abs(ndc.y) > 1.0f)) {
+        return 1.0f; // 超出光源视锥；立方体面在边缘处夹取到面内
     }
-    
-    float closestDepth = shadowMap[y * SHADOW_MAP_SIZE + x];
-    
-    // 当前片段在光源空间的深度
-    float currentDepth = projCoords.z;
-    
-    // 自适应阴影偏移，基于深度梯度
-    float bias = 0.001f; // 基础bias
-    float maxBias = 0.01f;
-    
-    // 如果深度很近最大值，说明这个区域没有被渲染到shadow map中
-    if (closestDepth >= 0.999f) {
-        return 1.0f; // 不在阴影中
+
+    // 与光栅化相同的视口变换（y 翻转）
+    const float x = (ndc.x + 1.0f) * 0.5f * size;
+    const float y = (1.0f - ndc.y) * 0.5f * size;
+
+    // 线性深度沿一个世界方向变化（透视取 clip.w 那一行，正交取 clip.z 那一行）；
+    // 表面相对该方向越倾斜，卷积核覆盖的深度差越大
+    const int row = view.projection.perspective ? 3 : 2;
+    const glm::vec3 depthAxis = glm::normalize(glm::vec3(view.viewProjection[0][row], view.viewProjection[1][row], view.viewProjection[2][row]));
+    const float cosine = std::max(std::abs(glm::dot(normal, depthAxis)), EPSILON);
+    const float slope = std::min(std::sqrt(std::max(1.0f - cosine * cosine, 0.0f)) / cosine, SHADOW_MAX_SLOPE);
+    return _filterShadow(v, x, y, view.projection.receiverDepth(clip), texel, slope);
+}
+
+// Biases grow with the filter radius: a kernel of r texels on a surface of depth
+// slope s (per texel) spans r * s of depth that must not count as occlusion.
+float Renderer::_filterShadow(size_t viewIdx, float x, float y, float receiverDepth, float texelSize, float slope) const {
+    const ShadowView& view = shadowViews[viewIdx];
+    auto reference = [&](float radius) { return receiverDepth - (SHADOW_DEPTH_BIAS + radius * slope) * texelSize; };
+    switch (shadowFilter) {
+    case ShadowAtlas::Filter::Hard:
+        return shadowAtlas.sampleHard(view.region, x, y, reference(0.5f));
+    case ShadowAtlas::Filter::PCF:
+        return shadowAtlas.samplePCF(view.region, x, y, reference(shadowPcfRadius), shadowPcfRadius);
+    case ShadowAtlas::Filter::PCSS: {
+        // 半影宽度（纹素）：透视光源按相似三角形，方向光按太阳角半径
+        const ShadowAtlas::Projection& projection = view.projection;
+        auto penumbra = [&](float blockerDepth) {
+            const float width = projection.perspective
+                ? pcssLightRadius * (receiverDepth - blockerDepth) / std::max(blockerDepth, EPSILON)
+                : std::tan(pcssSunAngle) * (receiverDepth - blockerDepth);
+            return std::clamp(width / texelSize, 1.0f, PCSS_MAX_RADIUS);
+        };
+        // 搜索范围取遮挡者贴近近平面时的半影
+        const float searchRadius = penumbra(projection.nearClip);
+        float blockerDepth;
+        if (!shadowAtlas.findBlockers(view.region, x, y, reference(searchRadius), searchRadius, blockerDepth)) return 1.0f;
+        const float radius = penumbra(blockerDepth);
+        return shadowAtlas.samplePCF(view.region, x, y, reference(radius), radius);
     }
-    
-    // 阴影测试，使用自适应bias
-    return (currentDepth - bias) > closestDepth ? 0.0f : 1.0f;
+    case ShadowAtlas::Filter::VSM:
+    case ShadowAtlas::Filter::EVSM:
+        // 矩在模糊核上平均过，最小方差同样按坡度放大
+        return shadowAtlas.sampleMoments(viewIdx, x, y, reference(0.5f), view.projection, (SHADOW_DEPTH_BIAS + 2.0f * slope) * texelSize);
+    }
+    return 1.0f;
 }
 
 Renderer::Renderer(int width, int height){
     screenWidth = width;
     screenHeight = height;
     framebuffer = Buffer<uint32_t>(width, height);
+    hdrBuffer = Buffer<glm::vec3>(width, height);
     zbuffer = Buffer<float>(width, height);
-    shadowMap = Buffer<float>(SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+    visibilityBuffer = Buffer<uint32_t>(width, height);
     
     // Initialize G-Buffer
-    gBufferPosition = Buffer<glm::vec3>(width, height);
-    gBufferNormal = Buffer<glm::vec3>(width, height);
-    gBufferAlbedo = Buffer<glm::vec3>(width, height);
-    gBufferColor = Buffer<uint32_t>(width, height);
+    gBuffer.resize(width, height);
     
     // Initialize SSAO/SSGI
     generateSSAOKernel();
     generateSSAONoise();
     
-    lightMatricesValid = false;
-    lastLightPosition = glm::vec3(0.0f);
     clearBuffers();
 }
 
@@ -778,58 +1470,21 @@ void Renderer::generateSSAONoise() {
     }
 }
 
-void Renderer::renderGBuffer(Scene scene) {
-    // Clear G-Buffer
-    gBufferPosition.clear(glm::vec3(0.0f));
-    gBufferNormal.clear(glm::vec3(0.0f));
-    gBufferAlbedo.clear(glm::vec3(0.0f));
-    gBufferColor.clear(0xFF000000);
-    
-    scene.camera.setAspect(static_cast<float>(screenWidth) / screenHeight);
-    glm::mat4 projectionMatrix = scene.camera.getProjectionMatrix();
-    glm::mat4 viewMatrix = scene.camera.getViewMatrix();
-    glm::mat4 viewProjectionMatrix = projectionMatrix * viewMatrix;
-    
-    for (const auto& objectPtr : scene.objects) {
-        Object& object = *objectPtr;
-        glm::mat4 modelMatrix = object.getMatrix();
-        glm::mat4 normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelMatrix)));
-        glm::mat4 mvp = viewProjectionMatrix * modelMatrix;
-
-        const Mesh& mesh = object.getMesh();
-        const std::vector<Vertex>& vertices = mesh.vertices;
-        const std::vector<unsigned int>& indices = mesh.indices;
-
-        for (size_t i = 0; i < indices.size(); i += 3) {
-            VertexShaderOutput v0 = vertexShader(vertices[indices[i]], modelMatrix, normalMatrix, mvp);
-            VertexShaderOutput v1 = vertexShader(vertices[indices[i+1]], modelMatrix, normalMatrix, mvp);
-            VertexShaderOutput v2 = vertexShader(vertices[indices[i+2]], modelMatrix, normalMatrix, mvp);
+// Uses the camera of the current frame (see _beginFrame)
+void Renderer::renderGBuffer(const Scene& scene) {
+    gBuffer.clear();
 
-            std::vector<std::array<VertexShaderOutput, 3>> clippedTriangles;
-            clip_triangle_against_near_plane(v0, v1, v2, clippedTriangles);
-
-            for (const auto& tri : clippedTriangles) {
-                glm::vec3 s0 = ndcToScreen(tri[0].clipPos / tri[0].clipPos.w);
-                glm::vec3 s1 = ndcToScreen(tri[1].clipPos / tri[1].clipPos.w);
-                glm::vec3 s2 = ndcToScreen(tri[2].clipPos / tri[2].clipPos.w);
-
-                _drawTriangleGBuffer(tri[0], tri[1], tri[2], s0, s1, s2, object.getMaterial());
-            }
-        }
-    }
+    _drawCameraPass(scene, nullptr, [this, &scene](const RasterTriangle& tri, uint32_t, RasterTile& tile) {
+        _drawTriangleGBuffer(tri, scene.getMaterial(tri.materialId), tile);
+    });
 }
 
-void Renderer::_drawTriangleGBuffer(
-    const VertexShaderOutput& v0, const VertexShaderOutput& v1, const VertexShaderOutput& v2,
-    const glm::vec3& s0, const glm::vec3& s1, const glm::vec3& s2,
-    std::shared_ptr<Material> material) {
-    
-    float area = glm::cross(s1 - s0, s2 - s0).z;
-    if (fabs(area) < EPSILON) return;
-    if (area < 0.0f) {
-        _drawTriangleGBuffer(v0, v2, v1, s0, s2, s1, material);
-        return;
-    }
+// G-Buffer attributes are written straight to the full-screen buffers: a tile only
+// ever touches its own pixels, so only the depth test needs tile-local storage.
+void Renderer::_drawTriangleGBuffer(const RasterTriangle& tri, const Material& material, RasterTile& tile) {
+    const VertexShaderOutput& v0 = tri.v[0];
+    const VertexShaderOutput& v1 = tri.v[1];
+    const VertexShaderOutput& v2 = tri.v[2];
     
     float invW0 = 1.0f / v0.w;
     float invW1 = 1.0f / v1.w;
@@ -840,61 +1495,44 @@ void Renderer::_drawTriangleGBuffer(
     glm::vec3 n0_w = v0.normal * invW0;
     glm::vec3 n1_w = v1.normal * invW1;
     glm::vec3 n2_w = v2.normal * invW2;
-
-    int minX = std::max(0, (int)std::floor(std::min({ s0.x, s1.x, s2.x })));
-    int maxX = std::min(screenWidth - 1, (int)std::ceil(std::max({ s0.x, s1.x, s2.x })));
-    int minY = std::max(0, (int)std::floor(std::min({ s0.y, s1.y, s2.y })));
-    int maxY = std::min(screenHeight - 1, (int)std::ceil(std::max({ s0.y, s1.y, s2.y })));
-
-    for (int y = minY; y <= maxY; ++y) {
-        for (int x = minX; x <= maxX; ++x) {
-            glm::vec3 p(x + 0.5f, y + 0.5f, 0.0f);
-            if (_insideTriangle(p, s0, s1, s2)) {
-                float a = (glm::cross(s1 - p, s2 - p)).z / area;
-                float b = (glm::cross(s2 - p, s0 - p)).z / area;
-                float c = (glm::cross(s0 - p, s1 - p)).z / area;
-
-                float z = a * s0.z + b * s1.z + c * s2.z;
-                int idx = y * screenWidth + x;
-                
-                if (z < zbuffer[idx]) {
-                    zbuffer[idx] = z;
-                    
-                    // Store G-Buffer data
-                    glm::vec3 worldPos = v0.worldPos * a + v1.worldPos * b + v2.worldPos * c;
-                    glm::vec3 normal = glm::normalize(n0_w * a + n1_w * b + n2_w * c);
-                    
-                    float invW = a * invW0 + b * invW1 + c * invW2;
-                    glm::vec2 uv = (a * uv0_w + b * uv1_w + c * uv2_w) / invW;
-                    glm::vec3 albedo = material->sampleBaseColor(uv);
-                    
-                    gBufferPosition[idx] = worldPos;
-                    gBufferNormal[idx] = normal;
-                    gBufferAlbedo[idx] = albedo;
-                }
-            }
-        }
-    }
+    // 视空间线性深度同样做透视校正插值（正交投影下 w = 1，退化为线性插值）
+    const glm::vec3 viewZ(frameCamera.viewMatrix[0][2], frameCamera.viewMatrix[1][2], frameCamera.viewMatrix[2][2]);
+    const float viewZOffset = frameCamera.viewMatrix[3][2];
+    float d0_w = -(glm::dot(viewZ, v0.worldPos) + viewZOffset) * invW0;
+    float d1_w = -(glm::dot(viewZ, v1.worldPos) + viewZOffset) * invW1;
+    float d2_w = -(glm::dot(viewZ, v2.worldPos) + viewZOffset) * invW2;
+
+    rasterizeTriangle(tri, tile, [&](int x, int y, int, float a, float b, float c) {
+        int idx = y * screenWidth + x;
+
+        // Store G-Buffer data
+        glm::vec3 normal = glm::normalize(n0_w * a + n1_w * b + n2_w * c);
+
+        float invW = a * invW0 + b * invW1 + c * invW2;
+        glm::vec2 uv = (a * uv0_w + b * uv1_w + c * uv2_w) / invW;
+        glm::vec3 albedo = material.sampleBaseColor(uv);
+
+        gBuffer.depth[idx] = (a * d0_w + b * d1_w + c * d2_w) / invW;
+        gBuffer.normal[idx] = GBuffer::encodeNormal(normal);
+        gBuffer.albedo[idx] = GBuffer::encodeAlbedo(albedo);
+    });
 }
 
-float Renderer::computeSSAO(int x, int y, Camera& camera) {
+float Renderer::computeSSAO(int x, int y, const FrameCamera& camera) {
     // [优化] 将所有不变的计算移到函数顶部
-    const glm::mat4 viewMatrix = camera.getViewMatrix();
-    const glm::mat4 projMatrix = camera.getProjectionMatrix();
+    const glm::mat4& viewMatrix = camera.viewMatrix;
+    const glm::mat4& projMatrix = camera.projectionMatrix;
 
     int idx = y * screenWidth + x;
-    
-    // 从 G-Buffer 获取世界空间数据
-    const glm::vec3 fragPos_world = gBufferPosition[idx];
-    const glm::vec3 normal_world = gBufferNormal[idx];
-    
-    if (glm::length(normal_world) < EPSILON) {
+
+    const float depth = gBuffer.depth[idx];
+    if (depth == GBuffer::NO_GEOMETRY) {
         return 1.0f; // No geometry, no occlusion
     }
 
-    // [修正] 将原始片段的位置和法线转换到视图空间
-    const glm::vec3 fragPos_view = glm::vec3(viewMatrix * glm::vec4(fragPos_world, 1.0));
-    const glm::vec3 normal_view = glm::normalize(glm::mat3(viewMatrix) * normal_world);
+    // 视图空间位置由深度重建，法线从世界空间转换到视图空间
+    const glm::vec3 fragPos_view = _gBufferViewPosition(x, y, depth, camera, screenWidth, screenHeight);
+    const glm::vec3 normal_view = glm::normalize(glm::mat3(viewMatrix) * GBuffer::decodeNormal(gBuffer.normal[idx]));
     
     // 在视图空间中创建 TBN 矩阵，这样就不用在循环里反复转换了
     glm::vec3 randomVec = getRandomVector(x, y); // 假设 randomVec 在 [0,1] 范围
@@ -921,19 +1559,18 @@ float Renderer::computeSSAO(int x, int y, Camera& camera) {
             int sampleY = static_cast<int>((1.f - sample_uv.y) * screenHeight);
             
             int sampleIdx = sampleY * screenWidth + sampleX;
-            glm::vec3 occluderPos_world = gBufferPosition[sampleIdx];
-            
-            // [修正] 将采样的遮挡点也转换到视图空间
-            glm::vec3 occluderPos_view = glm::vec3(viewMatrix * glm::vec4(occluderPos_world, 1.0));
 
-            // [修正] 在视图空间 Z 轴上进行深度比较
-            // occluderPos_view.z 是G-Buffer中记录的实际场景深度
+            // 遮挡点只需要深度：G-Buffer 存的就是视图空间线性深度（背景为 NO_GEOMETRY，不会遮挡）
+            const float occluderZ = -gBuffer.depth[sampleIdx];
+
+            // 在视图空间 Z 轴上进行深度比较
+            // occluderZ 是G-Buffer中记录的实际场景深度
             // samplePos_view.z 是我们采样点的深度
             // 在右手坐标系（OpenGL默认）中，Z值更小代表离相机更近，所以用 >
             // 如果是左手坐标系（DirectX默认），则用 <
-            if (occluderPos_view.z > samplePos_view.z + SSAO_BIAS) {
+            if (occluderZ > samplePos_view.z + SSAO_BIAS) {
                 // 为了防止背景或远处的物体对近处物体造成错误遮挡，可以加一个范围检查
-                float rangeCheck = (glm::abs(fragPos_view.z - occluderPos_view.z) < SSAO_RADIUS) ? 1.0f : 0.0f;
+                float rangeCheck = (glm::abs(fragPos_view.z - occluderZ) < SSAO_RADIUS) ? 1.0f : 0.0f;
                 occlusion += rangeCheck;
             }
         }
@@ -942,15 +1579,15 @@ float Renderer::computeSSAO(int x, int y, Camera& camera) {
     occlusion = 1.0f - (occlusion / SSAO_SAMPLES);
     return occlusion;
 }
-glm::vec3 Renderer::computeSSGI(int x, int y, Camera& camera) {
+glm::vec3 Renderer::computeSSGI(int x, int y, const FrameCamera& camera) {
     int idx = y * screenWidth + x;
-    
-    glm::vec3 fragPos = gBufferPosition[idx];
-    glm::vec3 normal = gBufferNormal[idx];
-    
-    if (glm::length(normal) < EPSILON) {
+
+    const float depth = gBuffer.depth[idx];
+    if (depth == GBuffer::NO_GEOMETRY) {
         return glm::vec3(0.0f);
     }
+    glm::vec3 fragPos = glm::vec3(camera.inverseViewMatrix * glm::vec4(_gBufferViewPosition(x, y, depth, camera, screenWidth, screenHeight), 1.0f));
+    glm::vec3 normal = GBuffer::decodeNormal(gBuffer.normal[idx]);
     
     glm::vec3 indirectLight(0.0f);
     glm::vec3 randomVec = getRandomVector(x, y);
@@ -963,11 +1600,7 @@ glm::vec3 Renderer::computeSSGI(int x, int y, Camera& camera) {
         glm::vec3 samplePos = fragPos + sampleDir * SSGI_RADIUS;
         
         // Project to screen space
-        glm::mat4 viewMatrix = camera.getViewMatrix();
-        glm::mat4 projMatrix = camera.getProjectionMatrix();
-        glm::mat4 viewProjMatrix = projMatrix * viewMatrix;
-        
-        glm::vec4 offset = viewProjMatrix * glm::vec4(samplePos, 1.0f);
+        glm::vec4 offset = camera.viewProjectionMatrix * glm::vec4(samplePos, 1.0f);
         glm::vec3 offsetXYZ = glm::vec3(offset) / offset.w;
         offsetXYZ = offsetXYZ * 0.5f + 0.5f;
         
@@ -978,10 +1611,8 @@ glm::vec3 Renderer::computeSSGI(int x, int y, Camera& camera) {
                 int sampleIdx = sampleY * screenWidth + sampleX;
                 
                 // Sample the lighting information
-                glm::vec3 sampleAlbedo = gBufferAlbedo[sampleIdx];
-                glm::vec3 sampleNormal = gBufferNormal[sampleIdx];
-                
-                if (glm::length(sampleNormal) > EPSILON) {
+                if (gBuffer.depth[sampleIdx] != GBuffer::NO_GEOMETRY) {
+                    glm::vec3 sampleAlbedo = GBuffer::decodeAlbedo(gBuffer.albedo[sampleIdx]);
                     float NdotL = glm::max(0.0f, glm::dot(normal, sampleDir));
                     float distance = glm::length(samplePos - fragPos);
                     float attenuation = 1.0f / (1.0f + distance * distance);
@@ -995,6 +1626,19 @@ glm::vec3 Renderer::computeSSGI(int x, int y, Camera& camera) {
     return indirectLight / float(SSGI_SAMPLES);
 }
 
+// View-space point at linear depth on the ray through the center of pixel (x, y),
+// for perspective and orthographic projections alike
+glm::vec3 Renderer::_gBufferViewPosition(int x, int y, float depth, const FrameCamera& camera, int width, int height) {
+    const glm::mat4& p = camera.projectionMatrix;
+    const float ndcX = (x + 0.5f) / width * 2.0f - 1.0f;
+    const float ndcY = 1.0f - (y + 0.5f) / height * 2.0f;
+    // clip.w = -p[2][3] * z_view (+ p[3][3])：透视时 w 就是深度，正交时 w = 1
+    const float w = p[2][3] * -depth + p[3][3];
+    return glm::vec3((ndcX * w - p[2][0] * -depth - p[3][0]) / p[0][0],
+                     (ndcY * w - p[2][1] * -depth - p[3][1]) / p[1][1],
+                     -depth);
+}
+
 glm::vec3 Renderer::getRandomVector(int x, int y) {
     int noiseX = x % 4;
     int noiseY = y % 4;
@@ -1013,104 +1657,87 @@ glm::vec3 Renderer::screenToWorldPosition(float x, float y, float depth, const g
     return glm::vec3(worldSpacePos) / worldSpacePos.w;
 }
 
-void Renderer::renderWithSSAO(Scene scene) {
+void Renderer::renderWithSSAO(const Scene& scene) {
     clearBuffers();
+    _beginFrame(scene.camera);
     
-    // First pass: Render shadow map
-    if (!scene.lights.empty()) {
-        renderShadowMap(scene, scene.lights[0]);
-    }
+    // First pass: Render shadow maps
+    renderShadowMaps(scene);
     
     // Second pass: Render G-Buffer
     renderGBuffer(scene);
+    _cullLights(scene.lights, frameCamera.viewProjectionMatrix);
     
-    // Third pass: Direct lighting with G-Buffer data
-    // Instead of re-rendering geometry, compute lighting directly from G-Buffer
-    for (int y = 0; y < screenHeight; ++y) {
-        for (int x = 0; x < screenWidth; ++x) {
-            int idx = y * screenWidth + x;
-            
-            // Skip pixels with no geometry
-            if (glm::length(gBufferNormal[idx]) < EPSILON) {
-                continue;
-            }
-            
-            glm::vec3 worldPos = gBufferPosition[idx];
-            glm::vec3 normal = gBufferNormal[idx];
-            glm::vec3 albedo = gBufferAlbedo[idx];
-            
-            glm::vec3 directLight(0.0f);
-            
-            // Compute direct lighting for each light
-            for (const auto& light : scene.lights) {
-                if (light->getDistance(worldPos) < EPSILON) continue;
-                
-                glm::vec3 lightDir = light->getDirection(worldPos);
-                glm::vec3 viewDir = glm::normalize(scene.camera.getPosition() - worldPos);
-                glm::vec3 lightColor = light->getColor() * light->getIntensity(worldPos);
-                
-                // Apply shadow
-                float shadowFactor = 1.0f;
-                if (!scene.lights.empty()) {
-                    shadowFactor = sampleShadowMap(worldPos);
+    // Third pass: direct lighting, SSAO + SSGI, composite and tone mapping, fused.
+    // Each pixel only reads its own G-buffer texel and neighbours in the G-buffer,
+    // never another pixel's result, so screen tiles are independent jobs: a tile's
+    // G-buffer data is read once for all stages while it is in cache, and its
+    // light list is the one _cullLights built for it.
+    const int tileCount = lightTilesX * lightTilesY;
+    #pragma omp parallel for schedule(dynamic)
+    for (int t = 0; t < tileCount; ++t) {
+        const int x0 = (t % lightTilesX) * TILE_SIZE;
+        const int y0 = (t / lightTilesX) * TILE_SIZE;
+        const int x1 = std::min(x0 + TILE_SIZE, screenWidth);
+        const int y1 = std::min(y0 + TILE_SIZE, screenHeight);
+        const std::vector<uint32_t>& lightList = tileLights[t];
+
+        for (int y = y0; y < y1; ++y) {
+            for (int x = x0; x < x1; ++x) {
+                int idx = y * screenWidth + x;
+
+                // Skip pixels with no geometry
+                const float depth = gBuffer.depth[idx];
+                if (depth == GBuffer::NO_GEOMETRY) {
+                    continue;
                 }
-                
-                // Compute Phong shading
-                glm::vec3 L = lightDir;
-                glm::vec3 N = glm::normalize(normal);
-                glm::vec3 V = viewDir;
-                glm::vec3 R = glm::normalize(2.0f * glm::dot(N, L) * N - L);
 
-                float diff = glm::max(0.0f, glm::dot(N, L));
-                float spec = std::pow(glm::max(0.0f, glm::dot(R, V)), 16.0f);
+                glm::vec3 worldPos = glm::vec3(frameCamera.inverseViewMatrix * glm::vec4(_gBufferViewPosition(x, y, depth, frameCamera, screenWidth, screenHeight), 1.0f));
+                glm::vec3 normal = GBuffer::decodeNormal(gBuffer.normal[idx]);
+                glm::vec3 albedo = GBuffer::decodeAlbedo(gBuffer.albedo[idx]);
 
-                glm::vec3 diffuse = diff * albedo;
-                glm::vec3 specular = spec * glm::vec3(1.0f, 1.0f, 1.0f);
+                glm::vec3 directLight(0.0f);
+                for (uint32_t lightIdx : lightList) {
+                    const auto& light = scene.lights[lightIdx];
+                    if (light->getDistance(worldPos) < EPSILON) continue;
+                    const float window = light->rangeWindow(worldPos); // 逐像素范围判断
+                    if (window <= 0.0f) continue;
 
-                directLight += (diffuse + specular) * lightColor * shadowFactor;
-            }
-            
-            directLight = glm::clamp(directLight, 0.0f, 1.0f);
-            framebuffer[idx] = Color::VecToUint32(directLight);
-        }
-    }
-    
-    // Fourth pass: Apply SSAO and SSGI
-    for (int y = 0; y < screenHeight; ++y) {
-        for (int x = 0; x < screenWidth; ++x) {
-            int idx = y * screenWidth + x;
-            
-            // Skip pixels with no geometry
-            if (glm::length(gBufferNormal[idx]) < EPSILON) {
-                continue;
-            }
-            
-            // Compute SSGI
-            glm::vec3 indirectLight = computeSSGI(x, y, scene.camera);
-            
-            // Get current pixel color (direct lighting)
-            glm::vec3 directLight = Color::Uint32ToVec(framebuffer[idx]);
-            
-            // Apply ambient occlusion to ambient lighting
-            float aofactor = computeSSAO(x, y, scene.camera);
-            glm::vec3 ambient = gBufferAlbedo[idx] * ambientIntensity * aofactor;
-            
-            // Combine direct lighting, ambient with AO, and indirect lighting with intensity controls
-            glm::vec3 finalColor = directLight * directLightIntensity + 
-                                 ambient * ssaoIntensity + 
+                    glm::vec3 lightDir = light->getDirection(worldPos);
+                    glm::vec3 viewDir = glm::normalize(frameCamera.position - worldPos);
+                    glm::vec3 lightColor = light->getColor() * (light->getIntensity(worldPos) * window);
+
+                    // Compute Phong shading
+                    glm::vec3 L = lightDir;
+                    glm::vec3 N = glm::normalize(normal);
+                    glm::vec3 V = viewDir;
+                    glm::vec3 R = glm::normalize(2.0f * glm::dot(N, L) * N - L);
+
+                    float diff = glm::max(0.0f, glm::dot(N, L));
+                    float spec = std::pow(glm::max(0.0f, glm::dot(R, V)), 16.0f);
+
+                    glm::vec3 diffuse = diff * albedo;
+                    glm::vec3 specular = spec * glm::vec3(1.0f, 1.0f, 1.0f);
+
+                    directLight += (diffuse + specular) * lightColor * sampleShadow(lightIdx, worldPos, N);
+                }
+                // negative light contributions are cut here; the upper bound is left to tone mapping
+                directLight = glm::max(directLight, glm::vec3(0.0f));
+
+                glm::vec3 indirectLight = computeSSGI(x, y, frameCamera);
+
+                // Apply ambient occlusion to ambient lighting
+                float aofactor = computeSSAO(x, y, frameCamera);
+                glm::vec3 ambient = albedo * ambientIntensity * aofactor;
+
+                // Combine direct lighting, ambient with AO, and indirect lighting with intensity controls
+                hdrBuffer[idx] = directLight * directLightIntensity +
+                                 ambient * ssaoIntensity +
                                  indirectLight * ssgiIntensity;
-            finalColor = glm::clamp(finalColor, 0.0f, 1.0f);
-            framebuffer[idx] = Color::VecToUint32(finalColor);
+            }
+
+            // tone mapping + sRGB encode, one tile row at a time
+            ToneMapper::resolveSpan(&hdrBuffer(x0, y), &framebuffer(x0, y), x1 - x0, toneMapping, exposure);
         }
     }
-    
-    // Gamma correction (same as original)
-    for (int i = 0; i < framebuffer.width * framebuffer.height; ++i) {
-        uint32_t color = framebuffer[i];
-        glm::vec3 linearColor = Color::Uint32ToVec(color);
-        linearColor.r = glm::pow(linearColor.r, 1.0f / 2.2f);
-        linearColor.g = glm::pow(linearColor.g, 1.0f / 2.2f);
-        linearColor.b = glm::pow(linearColor.b, 1.0f / 2.2f);
-        framebuffer[i] = Color::VecToUint32(linearColor);
-    }
 }
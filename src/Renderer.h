@@ -1,15 +1,25 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include "Buffer.h"
+#include "Camera.h"
+#include "CascadedShadowMap.h"
+#include "Frustum.h"
+#include "GBuffer.h"
+#include "OcclusionCuller.h"
+#include "Rasterizer.h"
+#include "ShadowAtlas.h"
+#include "ToneMapper.h"
 #include "Vertex.h"
 
-class Camera;
 struct Intersection;
 class Light;
 class Line;
 class Material;
+class Mesh;
+class Object;
 struct Ray;
 class Scene;
 struct Vertex;
@@ -23,14 +33,16 @@ private:
 	bool firstFrameSaved = false;
 public:
 	int screenWidth, screenHeight;
-	Buffer<uint32_t> framebuffer;
+	Buffer<uint32_t> framebuffer;      // display output, ARGB8888
+	Buffer<glm::vec3> hdrBuffer;       // linear radiance every pass accumulates into
 	Buffer<float> zbuffer;
+
+	// Visibility buffer: index into rasterTriangles of the visible triangle per pixel
+	static constexpr uint32_t INVALID_TRIANGLE = 0xFFFFFFFF;
+	Buffer<uint32_t> visibilityBuffer;
 	
 	// G-Buffer for SSAO/SSGI
-	Buffer<glm::vec3> gBufferPosition;  // World position
-	Buffer<glm::vec3> gBufferNormal;    // World normal
-	Buffer<glm::vec3> gBufferAlbedo;    // Base color
-	Buffer<uint32_t> gBufferColor;      // Direct lighting result
+	GBuffer gBuffer;
 	
 	// SSAO/SSGI settings
 	static constexpr int SSAO_SAMPLES = 16;
@@ -46,57 +58,175 @@ public:
 	float ssaoIntensity = 4.f;
 	float ssgiIntensity = 2.f;
 	float ambientIntensity = 0.1f;
+
+	// Display transform applied once to hdrBuffer at the end of each frame
+	ToneMapper::Operator toneMapping = ToneMapper::Operator::Clamp;
+	float exposure = 1.0f;
 	
-	// Shadow mapping
-	static constexpr int SHADOW_MAP_SIZE = 256;
-	Buffer<float> shadowMap;
-	glm::mat4 lightViewMatrix;
-	glm::mat4 lightProjectionMatrix;
-	glm::mat4 lightViewProjectionMatrix;
-	bool lightMatricesValid = false;
-	glm::vec3 lastLightPosition = glm::vec3(0.0f);
+	// Shadow mapping. Every light gets regions of shadowAtlas: directional lights
+	// one per cascade of shadowCascades, point lights the six faces of a cube, other
+	// lights one perspective map. Point and spot maps are up to shadowMapSize^2,
+	// smaller the less of the screen the light can reach. Sizes may change between
+	// frames.
+	static constexpr float SHADOW_DEPTH_BIAS = 2.0f;    // texels, applied to the linear receiver depth
+	static constexpr float SHADOW_NORMAL_OFFSET = 1.5f; // lookups move this many texels along the normal
+	static constexpr float SHADOW_MAX_SLOPE = 4.0f;     // depth change per texel the filter biases allow for
+	static constexpr float CUBE_SHADOW_NEAR = 0.05f;
+	static constexpr float SHADOW_SIZE_HYSTERESIS = 1.25f; // coverage must change by this factor past a threshold to resize
+	ShadowAtlas shadowAtlas;
+	CascadedShadowMap shadowCascades;
+	int shadowMapSize = 512;
+
+	// Shadow lookup filter. Hard: one comparison. PCF: 4x4 comparisons over
+	// shadowPcfRadius texels. PCSS: PCF widened by the penumbra estimated from a
+	// blocker search, for emitters of pcssLightRadius (point / spot, world units)
+	// or pcssSunAngle (directional, angular radius in radians). VSM / EVSM: one
+	// bilinear fetch of moment maps blurred once per rendered region.
+	ShadowAtlas::Filter shadowFilter = ShadowAtlas::Filter::PCF;
+	float shadowPcfRadius = 1.5f;
+	float pcssLightRadius = 0.05f;
+	float pcssSunAngle = 0.01f;
+	static constexpr float PCSS_MAX_RADIUS = 16.0f; // texels
+
+	// Per-frame camera state. The scene camera is copied once per frame with the
+	// viewport aspect applied, so passes read it without touching the Scene.
+	struct FrameCamera {
+		Camera camera;
+		glm::vec3 position;
+		glm::mat4 viewMatrix;
+		glm::mat4 inverseViewMatrix;
+		glm::mat4 projectionMatrix;
+		glm::mat4 viewProjectionMatrix;
+	};
+	FrameCamera frameCamera;
+
+	// Tile-binned rasterization (sort-middle)
+	static constexpr int TILE_SIZE = RasterTile::SIZE;
+
+	// Guard-band clipping: triangles are only clipped when they leave |x|,|y| <= GUARD_BAND * w
+	// or cross the near plane; everything else is trivially accepted
+	static constexpr float GUARD_BAND = 2.0f;
+	static constexpr int CLIP_PLANE_COUNT = 5;                      // near + 4 guard band planes
+	static constexpr int MAX_CLIP_VERTICES = 3 + CLIP_PLANE_COUNT;
+	static int clipTriangle(const VertexShaderOutput& v0, const VertexShaderOutput& v1, const VertexShaderOutput& v2,
+		uint32_t clipMask, VertexShaderOutput (&out)[MAX_CLIP_VERTICES]);
+	static int clipTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2,
+		uint32_t clipMask, glm::vec4 (&out)[MAX_CLIP_VERTICES]);             // positions only
+
+	// Mesh LOD selection: level 0 while the bounding sphere spans at least
+	// lodFullDetailPixels on screen, one level coarser per halving of that size
+	float lodFullDetailPixels = 256.0f;
+	int shadowLodBias = 1;                   // extra levels dropped in shadow map passes
+
+	// Camera passes skip objects hidden behind last frame's reprojected depth;
+	// anything the reprojection got wrong is drawn in a second pass
+	bool occlusionCulling = true;
 private:
+	struct DrawItem {
+		Object* object;
+		glm::mat4 mvp;
+		int lod;
+	};
+	std::vector<DrawItem> drawList;               // objects surviving frustum culling this pass
+	glm::vec4 drawEye{ 0.0f };                    // eye of the pass: (position, 1), or (view direction, 0) for orthographic
+	std::vector<unsigned int> clusterIndices;     // visible clusters of the object being set up, compacted
+	std::vector<Vertex> clusterVertices;          // vertices those clusters reference
+	std::vector<uint32_t> clusterVertexRemap;     // mesh vertex -> clusterVertices slot, UINT32_MAX between uses
+	std::vector<uint8_t> clusterVisible;          // per-cluster result of the culling pass
+	std::vector<DrawItem> occludedDraws;          // objects the reprojected depth culled, re-tested after the first pass
+	OcclusionCuller occlusionCuller;
+	VertexShaderOutputSoA vertexCache;            // post-transform vertices of the object being set up
+	std::vector<uint32_t> clipOffsets;            // per-triangle output offsets of the object being set up
+	std::vector<RasterTriangle> rasterTriangles;  // reused between passes and frames
+	std::vector<std::vector<uint32_t>> tileBins;  // triangle indices per tile, in submission order
+	int binWidth = 0, binHeight = 0;              // size of the target currently binned
+	int tilesX = 0, tilesY = 0;
+	std::vector<std::vector<uint32_t>> tileLights; // light indices per screen tile, in scene order
+	int lightTilesX = 0, lightTilesY = 0;
+
+	void _beginFrame(const Camera& camera);
+	void _buildDrawList(const Scene& scene, const glm::mat4& viewProjectionMatrix, int targetHeight, bool shadowPass = false);
+	void _setupTriangles(const Scene& scene, int targetWidth, int targetHeight, bool shadowPass = false); // appends drawList
+	template <typename ClipVertex>
+	void _assembleTriangles(const std::vector<unsigned int>& indices, MaterialId materialId, Material::CullMode cullMode,
+		int targetWidth, int targetHeight); // vertexCache -> rasterTriangles
+	bool _cullClusters(const Mesh& mesh, const DrawItem& item, Material::CullMode cullMode);
+	int _selectLod(const Mesh& mesh, const glm::mat4& modelMatrix, const glm::mat4& viewProjectionMatrix, int targetHeight) const;
+	void _binTriangles(int targetWidth, int targetHeight, uint32_t firstTriangle = 0);
+	void _resetBins(int targetWidth, int targetHeight);
+	void _binTriangleRange(uint32_t first, uint32_t end, int x0, int y0, int x1, int y1); // clamped to [x0, x1) x [y0, y1)
+	template <typename DrawFn>
+	void _rasterizeTiles(Buffer<float>& depthTarget, Buffer<uint32_t>* colorTarget, DrawFn drawTriangle,
+		int originX = 0, int originY = 0); // binned target placed at (originX, originY) of the buffers
+	template <typename DrawFn>
+	void _drawCameraPass(const Scene& scene, Buffer<uint32_t>* colorTarget, DrawFn drawTriangle);
+
 	// rasterization
 	glm::vec3 sampleTexture(const std::vector<uint32_t>& textureData, glm::vec2 uv, int texWidth, int texHeight);
-    bool _isBackFacingViewSpace( const glm::vec3& w0, const glm::vec3& w1, const glm::vec3& w2, const glm::vec3& cameraPosition);
-    static bool _insideTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
 
 	static std::vector<glm::vec3> clipToScreen(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, int screenWidth, int screenHeight);
 	glm::vec3 ndcToScreen(const glm::vec3& ndc) const;
-	glm::vec3 ndcToShadowMapScreen(const glm::vec3& ndc) const;
-    void clip_triangle_against_near_plane(const VertexShaderOutput& v0, const VertexShaderOutput& v1, const VertexShaderOutput& v2,
-        std::vector<std::array<VertexShaderOutput, 3>>& clipped_tris);
+	static glm::vec3 ndcToViewport(const glm::vec3& ndc, int width, int height);
+	static int _clippedTriangleCount(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2, Material::CullMode cullMode);
 	glm::vec3 _computePhongColor(const glm::vec3& pos, const glm::vec3& normal, const std::shared_ptr<Light>& light, const glm::vec3& cameraPos, const glm::vec3& baseColor);
 
-	void _drawTrianglePhong(
-		const VertexShaderOutput& v0, const VertexShaderOutput& v1, const VertexShaderOutput& v2,
-        const glm::vec3& s0, const glm::vec3& s1, const glm::vec3& s2,
-		const std::vector<std::shared_ptr< Light >>& lights, const Camera& camera, std::shared_ptr<Material> material);
+	// Visibility pass + resolve: Phong runs once per visible pixel, not per overdraw
+	void _drawTriangleVisibility(uint32_t triIdx, RasterTile& tile);
+	void _resolvePhong(const Scene& scene);
+	glm::vec3 _shadePhong(const RasterTriangle& tri, const glm::vec3& bary, const Material& material,
+		const std::vector<std::shared_ptr< Light >>& lights, const std::vector<uint32_t>& lightList, const glm::vec3& cameraPosition) const;
+
+	// Tiled light culling: per screen tile, indices of the lights that can reach it
+	void _cullLights(const std::vector<std::shared_ptr< Light >>& lights, const glm::mat4& viewProjectionMatrix);
+	const std::vector<uint32_t>& _lightsAt(int x, int y) const {
+		return tileLights[(y / TILE_SIZE) * lightTilesX + x / TILE_SIZE];
+	}
 
 	// Shadow mapping
-	void renderShadowMap(const Scene& scene, const std::shared_ptr<Light>& light);
-	void _drawTriangleDepthOnly(
-		const VertexShaderOutput& v0, const VertexShaderOutput& v1, const VertexShaderOutput& v2,
-		const glm::vec3& s0, const glm::vec3& s1, const glm::vec3& s2);
-	float sampleShadowMap(const glm::vec3& worldPos) const;
-	void setupLightMatrices(const std::shared_ptr<Light>& light);
+	struct ShadowView {
+		glm::mat4 viewProjection{ 1.0f };
+		ShadowAtlas::Projection projection;       // depth range, for linear depth
+		float splitFar = 0.0f;                    // cascades: view depth the view is used up to
+		ShadowAtlas::Region region;
+	};
+	struct LightShadow {
+		enum class Type { Single, Cascades, Cube };
+		Type type = Type::Single;
+		int firstView = 0, viewCount = 0;         // range of shadowViews, empty = unshadowed
+		glm::vec3 lightPosition{ 0.0f };          // cube: center the faces look out from
+		int size = 0;                             // point / spot: requested edge length, kept while coverage allows
+	};
+	std::vector<ShadowAtlas::Request> shadowRequests; // one per shadowViews entry
+	std::vector<ShadowView> shadowViews;
+	std::vector<LightShadow> lightShadows;            // per scene light
+
+	void renderShadowMaps(const Scene& scene);
+	Buffer<float> cubeFaceDepth;                      // the six faces of a cube stacked vertically
+	uint64_t _shadowSignature(const Scene& scene, const glm::mat4& lightViewProjection) const; // of drawList
+	void _renderShadowView(const Scene& scene, size_t viewIdx);
+	void _prepareShadowMoments(const LightShadow& shadow);
+	void _renderCubeShadow(const Scene& scene, size_t firstView);
+	static glm::mat4 _cubeFaceViewProjection(const glm::vec3& position, int face, float nearClip, float farClip);
+	float _shadowCoverage(const Light& light) const;
+	void _drawTriangleDepthOnly(const RasterTriangle& tri, uint32_t triIdx, RasterTile& tile);
+	float sampleShadow(uint32_t lightIdx, const glm::vec3& worldPos, const glm::vec3& normal) const;
+	float _filterShadow(size_t viewIdx, float x, float y, float receiverDepth, float texelSize, float slope) const;
+	static glm::mat4 _lightViewProjection(const Light& light, ShadowAtlas::Projection& projection);
 
 	// SSAO/SSGI
 	void generateSSAOKernel();
 	void generateSSAONoise();
-	void renderGBuffer(Scene scene);
-	void _drawTriangleGBuffer(
-		const VertexShaderOutput& v0, const VertexShaderOutput& v1, const VertexShaderOutput& v2,
-		const glm::vec3& s0, const glm::vec3& s1, const glm::vec3& s2,
-		std::shared_ptr<Material> material);
-	float computeSSAO(int x, int y, Camera& camera);
-	glm::vec3 computeSSGI(int x, int y, Camera& camera);
+	void renderGBuffer(const Scene& scene);
+	void _drawTriangleGBuffer(const RasterTriangle& tri, const Material& material, RasterTile& tile);
+	float computeSSAO(int x, int y, const FrameCamera& camera);
+	glm::vec3 computeSSGI(int x, int y, const FrameCamera& camera);
 	glm::vec3 getRandomVector(int x, int y);
+	static glm::vec3 _gBufferViewPosition(int x, int y, float depth, const FrameCamera& camera, int width, int height);
 	glm::vec3 screenToWorldPosition(float x, float y, float depth, const glm::mat4& invViewProjMatrix);
 	
 	// ray tracing
 	Ray computeReflectedRay(const Ray& ray, const Intersection& isect);
-	Ray computeRefractedRay(const Ray& ray, const Intersection& isect);
+	Ray computeRefractedRay(const Ray& ray, const Intersection& isect, float ior);
 
 	float fresnelSchlick(float cosTheta, float ior);
 	bool isInShadow(const glm::vec3& point, const Scene& scene, const glm::vec3& lightPos);
@@ -106,9 +236,10 @@ private:
 public:
 	void clearBuffers();
     const Buffer<uint32_t>& getBuffer() const { return framebuffer; }
-	void render(Scene scene);
-	void renderWithSSAO(Scene scene);  // New method with SSAO/SSGI
-	void renderRayTracing(Scene scene);
+	// Frame entry points: the scene is only read; per-frame camera state lives in frameCamera
+	void render(const Scene& scene);
+	void renderWithSSAO(const Scene& scene);  // New method with SSAO/SSGI
+	void renderRayTracing(const Scene& scene);
 
 	Renderer(int width, int height);
 
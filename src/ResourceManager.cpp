@@ -97,10 +97,28 @@ bool ResourceManager::loadMeshFromFile(const std::string& filename, Mesh& outMes
         }
     }
     outMesh.setName(filename);
+    outMesh.updateBounds();
+    outMesh.buildLods();
+    outMesh.buildClusters();
+    outMesh.buildBVH();
     file.close();
     return true;
 }
 
+std::shared_ptr<const Mesh> ResourceManager::loadSharedMesh(const std::string& filename) {
+    static std::unordered_map<std::string, std::weak_ptr<const Mesh>> cache;
+    if (auto mesh = cache[filename].lock()) {
+        return mesh;
+    }
+
+    auto mesh = std::make_shared<Mesh>();
+    if (!loadMeshFromFile(filename, *mesh)) {
+        return nullptr;
+    }
+    cache[filename] = mesh;
+    return mesh;
+}
+
 std::vector<uint32_t> ResourceManager::loadTextureFromFile(const std::string& path, int& texWidth, int& texHeight) {
     int channels;
     unsigned char* data = stbi_load(path.c_str(), &texWidth, &texHeight, &channels, 4); // Force 4 channels (RGBA)
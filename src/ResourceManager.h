@@ -1,5 +1,6 @@
 #pragma once
 #include <filesystem>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -20,6 +21,9 @@ private:
     std::filesystem::path getExecutabePath();
 public:
 	static bool loadMeshFromFile(const std::string& filename, Mesh& outMesh);
+    // Immutable mesh asset shared by every object that uses the file; parsed once
+    // while any user is alive. Returns nullptr if the file cannot be loaded.
+    static std::shared_ptr<const Mesh> loadSharedMesh(const std::string& filename);
     static std::vector<uint32_t> loadTextureFromFile(const std::string& path, int& texWidth, int& texHeight);
     static void saveFramebufferToBMP(const std::string& filename, const Buffer<uint32_t>& framebuffer);
 };
\ No newline at end of file
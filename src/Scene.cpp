@@ -1,7 +1,6 @@
 #include "Scene.h"
 
 #include <algorithm>
-#include <numeric> // For std::iota
 
 #include "Intersection.h"
 
@@ -21,229 +20,67 @@
 // }
 
 bool Scene::intersect(const Ray& ray, Intersection& closestIsect) const {
-    if (rootNodeIdx == -1 || bvhNodes.empty()) { // 如果没有构建 BVH，则回退到原始遍历（或报错）
-        // 原始遍历逻辑 (不建议保留，BVH是必须的)
-        bool hit = false;
-        // for (const auto& obj : objects) {
-        //     Intersection temp;
-        //     if (obj->intersect(ray, temp)) {
-        //         if (temp.t < closestIsect.t) {
-        //             closestIsect = temp;
-        //             hit = true;
-        //         }
-        //     }
-        // }
-        return hit;
-        printf("BVH is not built yet. Please call buildBVH() before intersecting.\n");
+    if (bvh.empty()) {
         return false;
     }
 
-    // 使用 BVH 遍历
     closestIsect.t = std::numeric_limits<float>::max(); // 重置为最大值
     bool hit = false;
-
-    // 创建一个栈来模拟递归遍历（非递归更适合性能）
-    std::vector<int> nodeStack;
-    nodeStack.push_back(rootNodeIdx); // 从根节点开始 (假设根节点索引是 0)
-
-    while (!nodeStack.empty()) {
-        int currentNodeIdx = nodeStack.back();
-        nodeStack.pop_back();
-
-        const BVHNode& node = bvhNodes[currentNodeIdx];
-
-        float t_min_aabb = 0.0f, t_max_aabb = std::numeric_limits<float>::max();
-        if (!node.bbox.intersect(ray, t_min_aabb, t_max_aabb)) {
-            continue; // 光线不与当前节点的包围盒相交，跳过
+    bvh.traverse(ray, closestIsect.t, [&](int primIdx) {
+        Intersection tempIsect = closestIsect; // 传入当前最近交点，更远的三角形直接跳过
+        if (bvhInstances[primIdx]->intersectMesh(ray, tempIsect) && tempIsect.t < closestIsect.t) {
+            closestIsect = tempIsect;
+            hit = true;
         }
-        
-        // 优化: 如果当前已知最近交点比 AABB 的 t_max 还近，也跳过
-        if (t_min_aabb >= closestIsect.t) {
-            continue;
-        }
-        if (node.isLeaf()) {
-            
-            // 遍历叶节点中的所有图元
-            for (int i = 0; i < node.numPrimitives; ++i) {
-                // const Triangle& tri = flattenedTriangles[node.firstPrimitiveIdx + i];
-                // 1. 从 primitiveIndices 获取真正的三角形索引
-                int primIdx = primitiveIndices[node.firstPrimitiveIdx + i]; 
-                // 2. 使用真正的索引访问 flattenedTriangles
-                const Triangle& tri = flattenedTriangles[primIdx];
-                Intersection tempIsect = closestIsect; // 传入当前最近交点的信息
-                // 注意：这里 Triangle::intersect 应该返回找到的交点，如果它比 tempIsect.t 更近
-                if (tri.intersect(ray, tempIsect)) { // Triangle 现在需要存储自己的 Material
-                    if (tempIsect.t < closestIsect.t) {
-                        closestIsect = tempIsect;
-                        hit = true;
-                    }
-                }
-            }
-        } else {
-            // 内部节点，按距离排序遍历子节点以提高效率
-            // 总是先检查更近的子节点
-            float t_left_aabb, t_right_aabb;
-            bool leftHit = node.leftChildIdx != -1 && bvhNodes[node.leftChildIdx].bbox.intersect(ray, t_left_aabb, t_max_aabb);
-            bool rightHit = node.rightChildIdx != -1 && bvhNodes[node.rightChildIdx].bbox.intersect(ray, t_right_aabb, t_max_aabb);
-
-            if (leftHit && rightHit) {
-                if (t_left_aabb < t_right_aabb) {
-                    nodeStack.push_back(node.rightChildIdx);
-                    nodeStack.push_back(node.leftChildIdx);
-                } else {
-                    nodeStack.push_back(node.leftChildIdx);
-                    nodeStack.push_back(node.rightChildIdx);
-                }
-            } else if (leftHit) {
-                nodeStack.push_back(node.leftChildIdx);
-            } else if (rightHit) {
-                nodeStack.push_back(node.rightChildIdx);
-            }
-        }
-    }
+        return false;
+    });
     return hit;
 }
 
 bool Scene::hasIntersection(const Ray& ray) const {
-    if (rootNodeIdx == -1) {
-        return false;
-    }
-
-    std::vector<int> nodeStack;
-    nodeStack.push_back(rootNodeIdx);
-
-    while (!nodeStack.empty()) {
-        int currentNodeIdx = nodeStack.back();
-        nodeStack.pop_back();
-
-        const BVHNode& node = bvhNodes[currentNodeIdx];
-
-        // 1. 检查光线是否与节点的包围盒相交
-        // 你的包围盒求交函数需要能处理 ray.t_min 和 ray.t_max
-        if (!node.bbox.intersect(ray)) { // 假设 AABB::intersect(ray) 会考虑 ray.t_max
-            continue;
-        }
+    // 找到任何一个在 t_max 范围内的交点就说明有遮挡，立即返回
+    return bvh.traverse(ray, ray.t_max, [&](int primIdx) {
+        return bvhInstances[primIdx]->occludesMesh(ray);
+    });
+}
 
-        // 2. 如果是叶子节点，检查其中的所有图元
-        if (node.isLeaf()) {
-            for (int i = 0; i < node.numPrimitives; ++i) {
-                int primIdx = this->primitiveIndices[node.firstPrimitiveIdx + i];
-                const Triangle& tri = this->flattenedTriangles[primIdx];
-                
-                // 只需要一个临时变量来接收求交结果，不需要完整的 Intersection
-                Intersection tempIsect; 
-                if (tri.intersect(ray, tempIsect)) {
-                    // 只要找到任何一个在 t_max 范围内的交点，就说明有遮挡
-                    // tri.intersect 应该保证返回的 tempIsect.t 在 [ray.t_min, ray.t_max] 之间
-                    return true; // 立即返回，这是效率的关键
-                }
-            }
-        } 
-        // 3. 如果是内部节点，将子节点加入栈中
-        else {
-            // 对于遮挡函数，子节点的遍历顺序不影响最终结果，可以不排序以简化代码
-            nodeStack.push_back(node.leftChildIdx);
-            nodeStack.push_back(node.rightChildIdx);
-        }
+// Returns the table index of the material, adding it on first use
+MaterialId Scene::registerMaterial(const std::shared_ptr<Material>& material) {
+    if (!material) return DEFAULT_MATERIAL;
+    for (size_t i = 0; i < materials.size(); ++i) {
+        if (materials[i] == material) return static_cast<MaterialId>(i);
+    }
+    if (materials.size() >= INVALID_MATERIAL) {
+        printf("Material table is full, falling back to the default material.\n");
+        return DEFAULT_MATERIAL;
     }
-    // 遍历完所有相关节点都没有找到交点
-    return false;
+    materials.push_back(material);
+    return static_cast<MaterialId>(materials.size() - 1);
 }
 
 void Scene::buildBVH() {
-    bvhNodes.clear();
-    flattenedTriangles.clear(); // 清空旧数据
+    bvhInstances.clear();
+    std::vector<AABB> instanceBounds;
+    std::vector<const Mesh*> uniqueMeshes;
+    size_t triangleCount = 0;
 
-    // 1. 扁平化所有 Mesh 的三角形
     for (const auto& objPtr : objects) {
-        Mesh& mesh = objPtr->getMesh();
-        if (typeid(mesh) == typeid(Mesh)) { // 检查是否是 Mesh
-            mesh.firstTriangleIdx = flattenedTriangles.size();
-            for (const auto& tri : mesh.triangles) {
-                flattenedTriangles.push_back(tri);
-            }
-            // printf("mesh %s has %zu triangles.\n", mesh.getName().c_str(), mesh.triangles.size());
-            mesh.numTriangles = flattenedTriangles.size() - mesh.firstTriangleIdx;
-            // 重要：Mesh 内部的 triangles 成员现在可以清空或不再使用
-            // 或者，你可以修改 Mesh 结构，让它只包含指向 Scene 中三角形数组的索引范围
+        // 材质可能在 addObject 之后被替换，重新登记
+        objPtr->setMaterialId(registerMaterial(objPtr->getMaterial()));
+        const Mesh& mesh = objPtr->getMesh();
+        if (mesh.bvh.empty()) continue; // 没有几何体
+
+        bvhInstances.push_back(objPtr.get());
+        instanceBounds.push_back(objPtr->getWorldBounds());
+        if (std::find(uniqueMeshes.begin(), uniqueMeshes.end(), &mesh) == uniqueMeshes.end()) {
+            uniqueMeshes.push_back(&mesh);
+            triangleCount += mesh.triangles.size();
         }
-        // 如果有其他类型的 Object (如 Sphere)，它们也需要被 BVH 管理
-        // 可以将它们也视为“图元”，或者构建一个混合 BVH
-    }
-
-    // 创建一个包含所有图元索引的列表
-    primitiveIndices.resize(flattenedTriangles.size());
-    std::iota(primitiveIndices.begin(), primitiveIndices.end(), 0); // 填充 0, 1, 2, ... num_triangles-1
-    // printf("flattenedTriangles has %zu triangles.\n", flattenedTriangles.size());
-    // 开始递归构建
-    bvhNodes.reserve(flattenedTriangles.size() * 2);
-    rootNodeIdx = buildBVHRecursive(0, primitiveIndices.size(), 0);
-    printf("BVH built with %zu triangles.\n", flattenedTriangles.size());
-}
-
-AABB Scene::getPrimitiveAABB(int primitiveIdx) const {
-    const Triangle& tri = flattenedTriangles[primitiveIdx];
-    AABB bbox;
-    bbox.extend(tri.vertices[0].worldPos);
-    bbox.extend(tri.vertices[1].worldPos);
-    bbox.extend(tri.vertices[2].worldPos);
-    return bbox;
-}
-
-int Scene::buildBVHRecursive(int start, int end, int currentDepth) {
-    int numPrims = end - start;
-    int currentNodeIdx = bvhNodes.size();
-    bvhNodes.emplace_back(); // 添加一个新节点
-
-    // BVHNode& node = bvhNodes[currentNodeIdx];
-
-    // 计算当前图元集合的 AABB
-    AABB currentBbox;
-    for (int i = start; i < end; ++i) {
-        currentBbox.extend(getPrimitiveAABB(primitiveIndices[i]));
     }
-    bvhNodes[currentNodeIdx].bbox = currentBbox;
-
-    if (numPrims <= MAX_PRIMS_IN_LEAF) { // MAX_PRIMS_IN_LEAF 是一个阈值，例如 4-8
-        // 创建叶节点
-        bvhNodes[currentNodeIdx].firstPrimitiveIdx = start;
-        bvhNodes[currentNodeIdx].numPrimitives = numPrims;
-        bvhNodes[currentNodeIdx].leftChildIdx = -1; // 叶节点没有子节点
-        bvhNodes[currentNodeIdx].rightChildIdx = -1; // 叶节点没有子节点
-    } else {
-        // 创建内部节点
-
-        // 找到最长的轴进行分割
-        glm::vec3 extent = currentBbox.maxBounds - currentBbox.minBounds;
-        int axis = 0;
-        if (extent.y > extent.x) axis = 1;
-        if (extent.z > extent[axis]) axis = 2;
-
-        // 按中点分割图元，或者使用 SAH (更优)
-        // 简单中点分割:
-        float midPoint = currentBbox.minBounds[axis] + extent[axis] / 2.0f;
-        // std::partition 返回一个迭代器，指向第一个不满足谓词条件的元素
-        // std::distance 计算这个迭代器相对于整个向量开头的偏移量
-        auto partition_point = std::partition(primitiveIndices.begin() + start, primitiveIndices.begin() + end,
-            [&](int primIdx) {
-                return getPrimitiveAABB(primIdx).minBounds[axis] < midPoint;
-            });
-
-        int mid = std::distance(primitiveIndices.begin(), partition_point);
-
-        // 处理分割导致一边为空的情况
-        if (mid == start || mid == end) {
-            // 如果无法有效分割，强制将图元分成两半
-            mid = start + numPrims / 2;
-        }
 
-        // 递归构建左右子树
-        bvhNodes[currentNodeIdx].leftChildIdx = buildBVHRecursive(start, mid, currentDepth + 1);
-        bvhNodes[currentNodeIdx].rightChildIdx = buildBVHRecursive(mid, end, currentDepth + 1);
-    
-        
-    }
-    return currentNodeIdx;
+    bvh.build(instanceBounds, MAX_INSTANCES_IN_LEAF);
+    printf("BVH built with %zu instances of %zu meshes (%zu triangles).\n",
+        bvhInstances.size(), uniqueMeshes.size(), triangleCount);
 }
 
 void Scene::setup(){
@@ -397,6 +234,7 @@ void Scene::setup(){
 
 Scene::Scene (){
     camera = Camera();
+    materials.push_back(Material::defualtMat());
     setup();
     buildBVH();
 }
\ No newline at end of file
@@ -14,21 +14,18 @@
 class Scene {
 private:
 	glm::vec3 backgroundColor = glm::vec3(0.05f);
-	int MAX_PRIMS_IN_LEAF = 4;
+	static constexpr int MAX_INSTANCES_IN_LEAF = 2;
 
-    std::vector<BVHNode> bvhNodes;
-    std::vector<Triangle> flattenedTriangles;
-    std::vector<int> primitiveIndices;
-    int rootNodeIdx = -1; // BVH 根节点的索引	
-
-    // 递归构建 BVH 的辅助函数
-    int buildBVHRecursive(int start, int end, int currentDepth);
-    // 获取图元 (三角形) 的 AABB
-    AABB getPrimitiveAABB(int primitiveIdx) const;
+    // 顶层 BVH：图元是物体实例，叶节点再进入各自 Mesh 的底层 BVH
+    BVH bvh;
+    std::vector<const Object*> bvhInstances; // BVH 图元索引 -> 物体
 	
 public:
 	std::vector<std::shared_ptr< Object >> objects; // primitive objects use shared_ptr for polymorphism
 	std::vector<std::shared_ptr< Light >> lights;
+	// Material table: triangles, intersections and draw calls refer to materials by
+	// MaterialId. Entry 0 is the default material.
+	std::vector<std::shared_ptr< Material >> materials;
 
 	Camera camera;
 
@@ -36,12 +33,17 @@ public:
 
 	void setup();
 
+	// Rebuilds the top-level BVH over object instances; call after objects move
 	void buildBVH();
 
 	void addObject(const std::shared_ptr<Object>& object) {
+		object->setMaterialId(registerMaterial(object->getMaterial()));
 		objects.push_back(object);
 	}
 
+	MaterialId registerMaterial(const std::shared_ptr<Material>& material);
+	const Material& getMaterial(MaterialId id) const { return *materials[id]; }
+
 	void removeObject(size_t index) {
 		if (index < objects.size()) {
 			objects.erase(objects.begin() + index);
@@ -0,0 +1,359 @@
+#include "ShadowAtlas.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SHADOW_USE_SSE 1
+#endif
+
+namespace {
+
+constexpr int MOMENT_BLUR_RADIUS = 2;               // box filter of 5x5 texels
+constexpr float EVSM_POSITIVE_EXPONENT = 40.0f;     // exp(2 * 40) still fits a float
+constexpr float EVSM_NEGATIVE_EXPONENT = 5.0f;
+constexpr float LIGHT_BLEEDING_REDUCTION = 0.2f;    // cut off the lowest part of the Chebyshev tail
+
+int floorPowerOfTwo(int v) {
+    int p = 1;
+    while (p * 2 <= v) p *= 2;
+    return p;
+}
+
+// One-sided Chebyshev bound: upper limit on the fraction of the filter region
+// farther away than t, i.e. lit
+float chebyshevUpperBound(float mean, float meanSquared, float t, float minVariance) {
+    if (t <= mean) return 1.0f;
+    const float variance = std::max(meanSquared - mean * mean, minVariance);
+    const float d = t - mean;
+    const float pMax = variance / (variance + d * d);
+    return std::clamp((pMax - LIGHT_BLEEDING_REDUCTION) / (1.0f - LIGHT_BLEEDING_REDUCTION), 0.0f, 1.0f);
+}
+
+} // namespace
+
+float ShadowAtlas::Projection::linearDepth(float d) const {
+    if (d >= std::numeric_limits<float>::max()) return d;
+    if (!perspective) return nearClip + d * (farClip - nearClip);
+    // 透视深度还原视空间深度
+    const float ndcZ = d * 2.0f - 1.0f;
+    const float denominator = (farClip + nearClip) - ndcZ * (farClip - nearClip);
+    return denominator > 0.0f ? 2.0f * farClip * nearClip / denominator : std::numeric_limits<float>::max();
+}
+
+float ShadowAtlas::Projection::receiverDepth(const glm::vec4& clip) const {
+    if (perspective) return clip.w;
+    return nearClip + (clip.z / clip.w + 1.0f) * 0.5f * (farClip - nearClip);
+}
+
+bool ShadowAtlas::allocate(const std::vector<Request>& requests) {
+    const int atlasSize = floorPowerOfTwo(std::max(size, minRegionSize));
+    bool resized = false;
+    if (depth.width != atlasSize || depth.height != atlasSize) {
+        depth = Buffer<float>(atlasSize, atlasSize);
+        depth.clear(std::numeric_limits<float>::max());
+        resized = true;
+    }
+    if (!resized && requests == requested) return false;
+
+    // 请求未变且拿到了完整尺寸的区域留在原处，连同已渲染的深度和 moments；
+    // 只有新增或改变的请求重新分配。放不下时整体重新布局
+    std::vector<int> previous(requests.size(), -1);
+    if (!resized) {
+        for (size_t i = 0; i < requests.size(); ++i) {
+            for (size_t p = 0; p < requested.size(); ++p) {
+                if (requests[i] == requested[p] && regions[p].size == _wantedSize(requests[i], atlasSize)) {
+                    previous[i] = static_cast<int>(p);
+                    break;
+                }
+            }
+        }
+    }
+    if (!_layout(requests, previous, atlasSize)) {
+        std::fill(previous.begin(), previous.end(), -1);
+        _layout(requests, previous, atlasSize);
+    }
+    requested = requests;
+    return true;
+}
+
+int ShadowAtlas::_wantedSize(const Request& request, int atlasSize) const {
+    return floorPowerOfTwo(std::clamp(request.size, minRegionSize, atlasSize));
+}
+
+// Places the requests with previous[i] < 0 around the regions kept from the last
+// layout. Returns false when one of them had to be halved.
+bool ShadowAtlas::_layout(const std::vector<Request>& requests, const std::vector<int>& previous, int atlasSize) {
+    std::vector<Region> newRegions(requests.size());
+    std::vector<uint64_t> newSignatures(requests.size(), 0);
+    std::vector<char> newRendered(requests.size(), 0);
+
+    // 保留的区域从四叉树中挖掉：找到包含它的空闲方块，逐级四分到它的大小
+    std::vector<Region> freeSquares{ { 0, 0, atlasSize } };
+    for (size_t i = 0; i < requests.size(); ++i) {
+        if (previous[i] < 0) continue;
+        const Region& kept = regions[previous[i]];
+        for (size_t f = 0; f < freeSquares.size(); ++f) {
+            Region square = freeSquares[f];
+            if (kept.x < square.x || kept.y < square.y || kept.x >= square.x + square.size || kept.y >= square.y + square.size) continue;
+            freeSquares.erase(freeSquares.begin() + f);
+            while (square.size > kept.size) {
+                const int half = square.size / 2;
+                const Region quarters[4] = { { square.x, square.y, half }, { square.x + half, square.y, half },
+                                             { square.x, square.y + half, half }, { square.x + half, square.y + half, half } };
+                for (const Region& q : quarters) {
+                    if (kept.x >= q.x && kept.y >= q.y && kept.x < q.x + half && kept.y < q.y + half) {
+                        square = q;
+                    } else {
+                        freeSquares.push_back(q);
+                    }
+                }
+            }
+            break;
+        }
+        newRegions[i] = kept;
+        newSignatures[i] = signatures[previous[i]];
+        newRendered[i] = rendered[previous[i]];
+    }
+
+    // 大的先分配；同样大小保持请求顺序（重要性）
+    std::vector<size_t> order;
+    for (size_t i = 0; i < requests.size(); ++i) {
+        if (previous[i] < 0) order.push_back(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return requests[a].size > requests[b].size; });
+
+    bool complete = true;
+    for (size_t i : order) {
+        const int wanted = _wantedSize(requests[i], atlasSize);
+        for (int want = wanted; want >= minRegionSize; want /= 2) {
+            // 取能放下的最小空闲方块，再四分到需要的大小
+            int best = -1;
+            for (int f = 0; f < static_cast<int>(freeSquares.size()); ++f) {
+                if (freeSquares[f].size >= want && (best < 0 || freeSquares[f].size < freeSquares[best].size)) best = f;
+            }
+            if (best < 0) continue; // 放不下，请求减半
+
+            Region square = freeSquares[best];
+            freeSquares.erase(freeSquares.begin() + best);
+            while (square.size > want) {
+                const int half = square.size / 2;
+                freeSquares.push_back({ square.x + half, square.y, half });
+                freeSquares.push_back({ square.x, square.y + half, half });
+                freeSquares.push_back({ square.x + half, square.y + half, half });
+                square.size = half;
+            }
+            newRegions[i] = square;
+            break;
+        }
+        complete &= newRegions[i].size == wanted;
+    }
+
+    // 有保留区域时布局不完整：交给调用者整体重新布局
+    if (!complete && std::any_of(previous.begin(), previous.end(), [](int p) { return p >= 0; })) return false;
+
+    std::vector<Buffer<glm::vec4>> newMoments(requests.size());
+    std::vector<Filter> newMomentFilters(requests.size(), Filter::Hard);
+    for (size_t i = 0; i < requests.size(); ++i) {
+        if (previous[i] < 0) continue;
+        newMoments[i] = std::move(moments[previous[i]]);
+        newMomentFilters[i] = momentFilters[previous[i]];
+    }
+    regions = std::move(newRegions);
+    signatures = std::move(newSignatures);
+    rendered = std::move(newRendered);
+    moments = std::move(newMoments);
+    momentFilters = std::move(newMomentFilters);
+    return true;
+}
+
+bool ShadowAtlas::isCached(size_t i, uint64_t signature) {
+    if (rendered[i] && signatures[i] == signature) return true;
+    signatures[i] = signature;
+    rendered[i] = 1;
+    momentFilters[i] = Filter::Hard;
+    return false;
+}
+
+void ShadowAtlas::clearRegion(const Region& region) {
+    for (int y = region.y; y < region.y + region.size; ++y) {
+        std::fill_n(&depth(region.x, y), region.size, std::numeric_limits<float>::max());
+    }
+}
+
+void ShadowAtlas::storeLinearDepth(const Region& region, const Buffer<float>& src, int srcX, int srcY,
+    const Projection& projection) {
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < region.size; ++y) {
+        for (int x = 0; x < region.size; ++x) {
+            depth(region.x + x, region.y + y) = projection.linearDepth(src(srcX + x, srcY + y));
+        }
+    }
+}
+
+// Moments are built at the region's own resolution and box-blurred in two passes,
+// so the per-pixel lookup is a single bilinear fetch whatever the kernel size.
+void ShadowAtlas::prepareMoments(size_t i, Filter filter, const Projection& projection) {
+    const Region& r = regions[i];
+    if (r.size == 0 || momentFilters[i] == filter) return;
+    momentFilters[i] = filter;
+
+    Buffer<glm::vec4>& m = moments[i];
+    if (m.width != r.size) m = Buffer<glm::vec4>(r.size, r.size);
+    if (momentScratch.width != r.size) momentScratch = Buffer<glm::vec4>(r.size, r.size);
+
+    const float range = std::max(projection.farClip - projection.nearClip, EPSILON);
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < r.size; ++y) {
+        for (int x = 0; x < r.size; ++x) {
+            const float d = std::min(depth(r.x + x, r.y + y), projection.farClip); // 背景当作远平面
+            if (filter == Filter::EVSM) {
+                const float t = std::clamp((d - projection.nearClip) / range, 0.0f, 1.0f);
+                const float positive = std::exp(EVSM_POSITIVE_EXPONENT * t);
+                const float negative = -std::exp(-EVSM_NEGATIVE_EXPONENT * t);
+                momentScratch(x, y) = glm::vec4(positive, positive * positive, negative, negative * negative);
+            } else {
+                momentScratch(x, y) = glm::vec4(d, d * d, 0.0f, 0.0f);
+            }
+        }
+    }
+
+    // 可分离盒式模糊：先横向（scratch -> m），再纵向（m -> scratch），最后换回 m
+    const float weight = 1.0f / (2 * MOMENT_BLUR_RADIUS + 1);
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < r.size; ++y) {
+        for (int x = 0; x < r.size; ++x) {
+            glm::vec4 sum(0.0f);
+            for (int k = -MOMENT_BLUR_RADIUS; k <= MOMENT_BLUR_RADIUS; ++k) {
+                sum += momentScratch(std::clamp(x + k, 0, r.size - 1), y);
+            }
+            m(x, y) = sum * weight;
+        }
+    }
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < r.size; ++y) {
+        for (int x = 0; x < r.size; ++x) {
+            glm::vec4 sum(0.0f);
+            for (int k = -MOMENT_BLUR_RADIUS; k <= MOMENT_BLUR_RADIUS; ++k) {
+                sum += m(x, std::clamp(y + k, 0, r.size - 1));
+            }
+            momentScratch(x, y) = sum * weight;
+        }
+    }
+    std::swap(m, momentScratch);
+}
+
+float ShadowAtlas::sampleHard(const Region& region, float x, float y, float reference) const {
+    const int tx = std::clamp(static_cast<int>(std::floor(x)), 0, region.size - 1);
+    const int ty = std::clamp(static_cast<int>(std::floor(y)), 0, region.size - 1);
+    return reference > depth(region.x + tx, region.y + ty) ? 0.0f : 1.0f;
+}
+
+// Taps sit at -1.5, -0.5, 0.5 and 1.5 steps from the center, radius = 1.5 steps.
+// With radius 1.5 the four taps of a row are adjacent texels.
+void ShadowAtlas::_tapPattern(const Region& region, float x, float y, float radius, int (&tx)[4], int (&ty)[4]) const {
+    static const float offsets[4] = { -1.5f, -0.5f, 0.5f, 1.5f };
+    const float step = radius / 1.5f;
+    for (int k = 0; k < 4; ++k) {
+        tx[k] = region.x + std::clamp(static_cast<int>(std::floor(x + offsets[k] * step)), 0, region.size - 1);
+        ty[k] = region.y + std::clamp(static_cast<int>(std::floor(y + offsets[k] * step)), 0, region.size - 1);
+    }
+}
+
+float ShadowAtlas::samplePCF(const Region& region, float x, float y, float reference, float radius) const {
+    int tx[4], ty[4];
+    _tapPattern(region, x, y, radius, tx, ty);
+
+#ifdef SHADOW_USE_SSE
+    // 一行四个比较一次完成；相邻纹素直接整行加载
+    const bool adjacent = tx[1] == tx[0] + 1 && tx[2] == tx[0] + 2 && tx[3] == tx[0] + 3;
+    const __m128 ref = _mm_set1_ps(reference);
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 lit = _mm_setzero_ps();
+    for (int r = 0; r < 4; ++r) {
+        const float* row = &depth(0, ty[r]);
+        const __m128 taps = adjacent ? _mm_loadu_ps(row + tx[0]) : _mm_set_ps(row[tx[3]], row[tx[2]], row[tx[1]], row[tx[0]]);
+        lit = _mm_add_ps(lit, _mm_and_ps(_mm_cmple_ps(ref, taps), one));
+    }
+    alignas(16) float sums[4];
+    _mm_store_ps(sums, lit);
+    return (sums[0] + sums[1] + sums[2] + sums[3]) * (1.0f / 16.0f);
+#else
+    int lit = 0;
+    for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 4; ++c) lit += reference <= depth(tx[c], ty[r]) ? 1 : 0;
+    }
+    return lit * (1.0f / 16.0f);
+#endif
+}
+
+bool ShadowAtlas::findBlockers(const Region& region, float x, float y, float reference, float radius, float& blockerDepth) const {
+    int tx[4], ty[4];
+    _tapPattern(region, x, y, radius, tx, ty);
+
+    float sum = 0.0f, count = 0.0f;
+#ifdef SHADOW_USE_SSE
+    const bool adjacent = tx[1] == tx[0] + 1 && tx[2] == tx[0] + 2 && tx[3] == tx[0] + 3;
+    const __m128 ref = _mm_set1_ps(reference);
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 depthSum = _mm_setzero_ps(), blockers = _mm_setzero_ps();
+    for (int r = 0; r < 4; ++r) {
+        const float* row = &depth(0, ty[r]);
+        const __m128 taps = adjacent ? _mm_loadu_ps(row + tx[0]) : _mm_set_ps(row[tx[3]], row[tx[2]], row[tx[1]], row[tx[0]]);
+        const __m128 nearer = _mm_cmplt_ps(taps, ref); // 背景 FLT_MAX 永远不是遮挡者
+        depthSum = _mm_add_ps(depthSum, _mm_and_ps(nearer, taps));
+        blockers = _mm_add_ps(blockers, _mm_and_ps(nearer, one));
+    }
+    alignas(16) float sums[4], counts[4];
+    _mm_store_ps(sums, depthSum);
+    _mm_store_ps(counts, blockers);
+    sum = sums[0] + sums[1] + sums[2] + sums[3];
+    count = counts[0] + counts[1] + counts[2] + counts[3];
+#else
+    for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 4; ++c) {
+            const float d = depth(tx[c], ty[r]);
+            if (d < reference) {
+                sum += d;
+                count += 1.0f;
+            }
+        }
+    }
+#endif
+    if (count == 0.0f) return false;
+    blockerDepth = sum / count;
+    return true;
+}
+
+float ShadowAtlas::sampleMoments(size_t i, float x, float y, float reference, const Projection& projection,
+    float minDeviation) const {
+    const Buffer<glm::vec4>& m = moments[i];
+    if (momentFilters[i] == Filter::Hard || m.width == 0) return 1.0f;
+
+    // 双线性：纹素中心在 +0.5
+    const float fx = x - 0.5f, fy = y - 0.5f;
+    const float x0f = std::floor(fx), y0f = std::floor(fy);
+    const float wx = fx - x0f, wy = fy - y0f;
+    const int ix = static_cast<int>(x0f), iy = static_cast<int>(y0f);
+    const int x0 = std::clamp(ix, 0, m.width - 1), x1 = std::clamp(ix + 1, 0, m.width - 1);
+    const int y0 = std::clamp(iy, 0, m.height - 1), y1 = std::clamp(iy + 1, 0, m.height - 1);
+    const glm::vec4 moment = glm::mix(glm::mix(m(x0, y0), m(x1, y0), wx), glm::mix(m(x0, y1), m(x1, y1), wx), wy);
+
+    if (momentFilters[i] == Filter::VSM) {
+        return chebyshevUpperBound(moment.x, moment.y, reference, minDeviation * minDeviation);
+    }
+
+    // EVSM：两个指数扭曲各给一个上界，取较小者。最小方差按扭曲函数在该深度的斜率缩放
+    const float range = std::max(projection.farClip - projection.nearClip, EPSILON);
+    const float t = std::clamp((reference - projection.nearClip) / range, 0.0f, 1.0f);
+    const float deviation = minDeviation / range;
+    const float positive = std::exp(EVSM_POSITIVE_EXPONENT * t);
+    const float negative = -std::exp(-EVSM_NEGATIVE_EXPONENT * t);
+    const float positiveDeviation = EVSM_POSITIVE_EXPONENT * positive * deviation;
+    const float negativeDeviation = EVSM_NEGATIVE_EXPONENT * negative * deviation;
+    const float litPositive = chebyshevUpperBound(moment.x, moment.y, positive, positiveDeviation * positiveDeviation);
+    const float litNegative = chebyshevUpperBound(moment.z, moment.w, negative, negativeDeviation * negativeDeviation);
+    return std::min(litPositive, litNegative);
+}
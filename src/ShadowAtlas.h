@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Buffer.h"
+#include "MyMath.h"
+
+class Light;
+
+// All shadow maps of a frame packed into one depth texture.
+//
+// Every shadowed view (a cascade, a spot light, ...) requests a square region.
+// Regions are power-of-two squares handed out largest first from a quadtree, and
+// a request that no longer fits is halved until it does. When the requests change,
+// regions whose request did not change stay where they are and only the others
+// are placed anew, so a region whose light and casters did not change keeps last
+// frame's depth and is not rendered again (see isCached).
+//
+// Depth is stored linearly in world units for every kind of view, so biases,
+// PCSS penumbra estimates and moment maps work the same way for orthographic
+// cascades and perspective spot / cube maps.
+class ShadowAtlas {
+public:
+    // Lookup filters. PCF and PCSS compare against the depth map, VSM and EVSM read
+    // moment maps that were blurred once when their region was rendered.
+    enum class Filter { Hard, PCF, PCSS, VSM, EVSM };
+
+    struct Request {
+        const Light* light;
+        int slice;       // cascade / face index within the light
+        int size;        // desired edge length in texels
+        bool operator==(const Request& o) const { return light == o.light && slice == o.slice && size == o.size; }
+    };
+
+    struct Region {
+        int x = 0, y = 0, size = 0; // size == 0: no space left, the view is unshadowed
+    };
+
+    // Depth range of a view, turns rasterizer depth into linear depth along the view axis
+    struct Projection {
+        float nearClip = 0.1f, farClip = 50.0f;
+        bool perspective = false;
+
+        float linearDepth(float depth) const;                  // depth = (ndc.z + 1) / 2
+        float receiverDepth(const glm::vec4& clip) const;      // the same for a clip space point
+    };
+
+    // Settings, read by allocate() so they can change between frames
+    int size = 2048;
+    int minRegionSize = 64;
+
+    // Linear depth in world units along each view's axis (storeLinearDepth),
+    // FLT_MAX where nothing was drawn
+    Buffer<float> depth;
+
+    // Lays out the requests. Returns true when the layout changed; regions that
+    // moved or are new are invalidated, the others keep their contents.
+    bool allocate(const std::vector<Request>& requests);
+    const Region& region(size_t i) const { return regions[i]; }
+
+    // True when region i already holds the view identified by signature (light
+    // matrix + casters). Otherwise the signature is recorded and false returned:
+    // the caller clears and renders the region.
+    bool isCached(size_t i, uint64_t signature);
+    void clearRegion(const Region& region);
+
+    // Converts the rasterizer depth in rows srcY.. of src (columns srcX..) to linear
+    // depth and stores it in the region. src may be the atlas itself.
+    void storeLinearDepth(const Region& region, const Buffer<float>& src, int srcX, int srcY, const Projection& projection);
+
+    // Builds the blurred VSM / EVSM moments of region i from its depth. Does nothing
+    // when they are up to date; rendering the region outdates them.
+    void prepareMoments(size_t i, Filter filter, const Projection& projection);
+
+    // Lookups, 1 = lit, 0 = shadowed. x, y are texel coordinates within the region
+    // (not clamped by the caller), reference is the receiver's biased linear depth.
+    float sampleHard(const Region& region, float x, float y, float reference) const;
+    // 4x4 comparisons spread over +-radius texels
+    float samplePCF(const Region& region, float x, float y, float reference, float radius) const;
+    // PCSS blocker search over the same pattern: average depth of the texels nearer than reference
+    bool findBlockers(const Region& region, float x, float y, float reference, float radius, float& blockerDepth) const;
+    // One bilinear fetch of region i's moments (prepareMoments) and a Chebyshev bound.
+    // minDeviation (world units) keeps flat surfaces from shadowing themselves.
+    float sampleMoments(size_t i, float x, float y, float reference, const Projection& projection, float minDeviation) const;
+
+private:
+    std::vector<Request> requested;
+    std::vector<Region> regions;
+    std::vector<uint64_t> signatures;
+    std::vector<char> rendered;
+
+    // Per region: moments for momentFilters[i], Filter::Hard = none built yet
+    std::vector<Buffer<glm::vec4>> moments;
+    std::vector<Filter> momentFilters;
+    Buffer<glm::vec4> momentScratch;   // horizontal blur pass
+
+    int _wantedSize(const Request& request, int atlasSize) const;
+    bool _layout(const std::vector<Request>& requests, const std::vector<int>& previous, int atlasSize);
+
+    // 4x4 tap pattern of PCF and the blocker search, clamped to the region
+    void _tapPattern(const Region& region, float x, float y, float radius, int (&tx)[4], int (&ty)[4]) const;
+};
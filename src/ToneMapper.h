@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TONEMAP_USE_SSE 1
+#endif
+
+#include "Buffer.h"
+#include "MyMath.h"
+
+// Final display pass: linear HDR radiance -> tone mapped, sRGB encoded pixels in
+// the SDL_PIXELFORMAT_ARGB8888 layout the window texture expects. This is the
+// only place lighting gets quantized to 8 bits.
+class ToneMapper {
+public:
+    enum class Operator {
+        Clamp,    // 直接截断到 [0, 1]
+        Reinhard, // x / (1 + x)
+        ACES      // Narkowicz 的 ACES filmic 拟合
+    };
+
+    static constexpr int LUT_SIZE = 4096;
+    static constexpr int CHUNK = 4096;     // pixels per parallel job in resolve(), a multiple of 4
+
+    static void resolve(const Buffer<glm::vec3>& hdr, Buffer<uint32_t>& out, Operator op, float exposure = 1.0f) {
+        const int count = std::min(hdr.width * hdr.height, out.width * out.height);
+        const int chunks = (count + CHUNK - 1) / CHUNK;
+
+        #pragma omp parallel for schedule(static)
+        for (int c = 0; c < chunks; ++c) {
+            const int first = c * CHUNK;
+            resolveSpan(hdr.data() + first, out.pixels.data() + first, std::min(CHUNK, count - first), op, exposure);
+        }
+    }
+
+    // count consecutive pixels on the calling thread, for passes that tone map
+    // their own tiles row by row
+    static void resolveSpan(const glm::vec3* hdr, uint32_t* dst, int count, Operator op, float exposure = 1.0f) {
+        static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "HDR buffer is read as packed floats");
+        const float* src = reinterpret_cast<const float*>(hdr);
+        const int packets = count / 4;
+        const uint8_t* lut = srgbLUT();
+
+        // 4 pixels = 12 channels = 3 SSE registers per iteration
+        for (int p = 0; p < packets; ++p) {
+            int lutIdx[12];
+#ifdef TONEMAP_USE_SSE
+            const __m128 scale = _mm_set1_ps(static_cast<float>(LUT_SIZE - 1));
+            for (int k = 0; k < 3; ++k) {
+                __m128 x = _mm_mul_ps(_mm_loadu_ps(src + p * 12 + k * 4), _mm_set1_ps(exposure));
+                x = _mm_max_ps(x, _mm_setzero_ps()); // also flushes NaN to 0
+                if (op == Operator::Reinhard) {
+                    x = _mm_div_ps(x, _mm_add_ps(x, _mm_set1_ps(1.0f)));
+                } else if (op == Operator::ACES) {
+                    __m128 num = _mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(2.51f)), _mm_set1_ps(0.03f)));
+                    __m128 den = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(2.43f)), _mm_set1_ps(0.59f))), _mm_set1_ps(0.14f));
+                    x = _mm_div_ps(num, den);
+                }
+                x = _mm_min_ps(x, _mm_set1_ps(1.0f));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(lutIdx + k * 4), _mm_cvtps_epi32(_mm_mul_ps(x, scale)));
+            }
+#else
+            for (int k = 0; k < 12; ++k) {
+                lutIdx[k] = lutIndex(src[p * 12 + k] * exposure, op);
+            }
+#endif
+            for (int k = 0; k < 4; ++k) {
+                dst[p * 4 + k] = pack(lut, lutIdx[k * 3], lutIdx[k * 3 + 1], lutIdx[k * 3 + 2]);
+            }
+        }
+
+        for (int i = packets * 4; i < count; ++i) {
+            dst[i] = pack(lut, lutIndex(src[i * 3] * exposure, op), lutIndex(src[i * 3 + 1] * exposure, op),
+                lutIndex(src[i * 3 + 2] * exposure, op));
+        }
+    }
+
+private:
+    static int lutIndex(float x, Operator op) {
+        x = x > 0.0f ? x : 0.0f;
+        if (op == Operator::Reinhard) {
+            x = x / (1.0f + x);
+        } else if (op == Operator::ACES) {
+            x = (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+        }
+        x = std::min(x, 1.0f);
+        return static_cast<int>(x * (LUT_SIZE - 1) + 0.5f);
+    }
+
+    static uint32_t pack(const uint8_t* lut, int r, int g, int b) {
+        return 0xFF000000u | (uint32_t(lut[r]) << 16) | (uint32_t(lut[g]) << 8) | uint32_t(lut[b]);
+    }
+
+    // Linear [0, 1] -> 8-bit sRGB, built once
+    static const uint8_t* srgbLUT() {
+        static const struct Table {
+            uint8_t values[LUT_SIZE];
+            Table() {
+                for (int i = 0; i < LUT_SIZE; ++i) {
+                    float c = static_cast<float>(i) / (LUT_SIZE - 1);
+                    float s = c <= 0.0031308f ? 12.92f * c : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+                    values[i] = static_cast<uint8_t>(s * 255.0f + 0.5f);
+                }
+            }
+        } table;
+        return table.values;
+    }
+};
@@ -52,7 +52,7 @@ bool Triangle::intersect(const Ray& ray, Intersection& isect) const {
         isect.t = t;
         isect.position = ray.origin + t * ray.direction;
         isect.normal = glm::normalize(glm::cross(edge1, edge2));
-        isect.material = material; // Use object's material
+        isect.materialId = materialId; // Use object's material
         isect.uv = (1 - u - v) * vertices[0].uv + u * vertices[1].uv + v * vertices[2].uv;
         isect.normal = glm::normalize((1 - u - v) * vertices[0].worldNormal + u * vertices[1].worldNormal + v * vertices[2].worldNormal);
         isect.hit = true;
@@ -17,16 +17,16 @@ struct TransformedVertex {
 
 struct Triangle{
     std::array<TransformedVertex, 3> vertices;
-    std::shared_ptr<Material> material;
+    MaterialId materialId;
 
     Triangle(const TransformedVertex& v0, const TransformedVertex& v1, const TransformedVertex& v2, 
-             const std::shared_ptr<Material>& mat) {
+             MaterialId mat) {
         vertices[0] = v0;
         vertices[1] = v1;
         vertices[2] = v2;
-        material = mat;
+        materialId = mat;
     }
-    Triangle(): vertices{ TransformedVertex(), TransformedVertex(), TransformedVertex()}, material(Material::defualtMat()) {};
+    Triangle(): vertices{ TransformedVertex(), TransformedVertex(), TransformedVertex()}, materialId(DEFAULT_MATERIAL) {};
 
     // Möller-Trumbore algorithm
     bool intersect(const Ray& ray, Intersection& isect) const;
@@ -1,4 +1,5 @@
 #pragma once
+#include <vector>
 #include "MyMath.h"
 
 struct Vertex {
@@ -25,3 +26,44 @@ struct VertexShaderOutput {
     float w;               // 原始 clipPos.w，用于透视校正插值
 };
 
+// Post-transform vertex cache: vertex shader output of every vertex of one mesh,
+// stored as structure-of-arrays so several vertices are shaded per SIMD instruction.
+// Arrays are padded to a multiple of PACKET so whole packets can be stored.
+struct VertexShaderOutputSoA {
+    static constexpr size_t PACKET = 4;
+
+    std::vector<float> clipX, clipY, clipZ, clipW;
+    std::vector<float> worldX, worldY, worldZ;
+    std::vector<float> normalX, normalY, normalZ;
+    std::vector<float> u, v;
+
+    void resize(size_t count) {
+        size_t padded = (count + PACKET - 1) / PACKET * PACKET;
+        for (std::vector<float>* a : { &clipX, &clipY, &clipZ, &clipW, &worldX, &worldY, &worldZ,
+                                       &normalX, &normalY, &normalZ, &u, &v }) {
+            a->resize(padded);
+        }
+    }
+
+    // Depth-only passes fill just the clip position arrays
+    void resizePositions(size_t count) {
+        size_t padded = (count + PACKET - 1) / PACKET * PACKET;
+        for (std::vector<float>* a : { &clipX, &clipY, &clipZ, &clipW }) {
+            a->resize(padded);
+        }
+    }
+
+    glm::vec4 getClipPos(size_t i) const {
+        return glm::vec4(clipX[i], clipY[i], clipZ[i], clipW[i]);
+    }
+
+    VertexShaderOutput get(size_t i) const {
+        VertexShaderOutput out;
+        out.clipPos = glm::vec4(clipX[i], clipY[i], clipZ[i], clipW[i]);
+        out.worldPos = glm::vec3(worldX[i], worldY[i], worldZ[i]);
+        out.normal = glm::vec3(normalX[i], normalY[i], normalZ[i]);
+        out.uv = glm::vec2(u[i], v[i]);
+        out.w = clipW[i];
+        return out;
+    }
+};